@@ -3,6 +3,10 @@ struct Material
 {
 	sampler2D diffuse;
 	sampler2D specular;
+	// with --material-array every material is a layer of these instead
+	sampler2DArray diffuseLayers;
+	sampler2DArray specularLayers;
+	bool layered;
 	float shininess;
 };
 
@@ -15,16 +19,18 @@ struct DirLight
 	vec3 specular;
 };
 
+// packed so it matches PointLightBlock in uniform_buffer.h
 struct PointLight
 {
 	vec3 position;
-
 	float constant;
-	float linear;
-	float quadratic;
 
 	vec3 ambient;
+	float linear;
+
 	vec3 diffuse;
+	float quadratic;
+
 	vec3 specular;
 };
 #define NR_POINT_LIGHTS 4
@@ -35,17 +41,44 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir);
 in vec2 TexCoord;
 in vec3 Normal;
 in vec3 FragPos;
+flat in uint MaterialLayer;
 
 out vec4 FragColor;
 
-uniform PointLight pointLights[NR_POINT_LIGHTS];
-uniform DirLight dirLight;
+// shared with every program, filled once per frame
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec3 cameraPos;
+};
+
+layout (std140) uniform Lights
+{
+	DirLight dirLight;
+	PointLight pointLights[NR_POINT_LIGHTS];
+};
+
 uniform Material material;
 
-uniform vec3 cameraPos;
+// sampled once in main, every light uses them
+vec3 diffuseTexel;
+vec3 specularTexel;
 
 void main()
 {
+	if (material.layered)
+	{
+		vec3 coord = vec3(TexCoord, float(MaterialLayer));
+		diffuseTexel = texture(material.diffuseLayers, coord).rgb;
+		specularTexel = texture(material.specularLayers, coord).rgb;
+	}
+	else
+	{
+		diffuseTexel = texture(material.diffuse, TexCoord).rgb;
+		specularTexel = texture(material.specular, TexCoord).rgb;
+	}
+
 	vec3 norm = normalize(Normal);
 	vec3 viewDir = normalize(cameraPos - FragPos);
 
@@ -69,9 +102,9 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir)
 	float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
 
 	// combine together
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoord));
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoord));
-	vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoord));
+	vec3 ambient = light.ambient * diffuseTexel;
+	vec3 diffuse = light.diffuse * diff * diffuseTexel;
+	vec3 specular = light.specular * spec * specularTexel;
 
 	// result
 	return specular + diffuse + ambient;
@@ -93,9 +126,9 @@ vec3 CalcPointLight(PointLight light, vec3 normal, vec3 fragPos, vec3 viewDir)
 	float attenuation = 1.0 / (light.constant + light.linear * dist + light.quadratic * (dist * dist));
 
 	// combine
-	vec3 ambient = light.ambient * vec3(texture(material.diffuse, TexCoord)) * attenuation;
-	vec3 diffuse = light.diffuse * diff * vec3(texture(material.diffuse, TexCoord)) * attenuation;
-	vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoord)) * attenuation;
+	vec3 ambient = light.ambient * diffuseTexel * attenuation;
+	vec3 diffuse = light.diffuse * diff * diffuseTexel * attenuation;
+	vec3 specular = light.specular * spec * specularTexel * attenuation;
 
 	// result
 	return specular + diffuse + ambient;
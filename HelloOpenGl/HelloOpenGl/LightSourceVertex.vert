@@ -3,11 +3,23 @@
 layout (location = 0) in vec3 aPos;
 
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+
+// decodes positions quantized to the mesh bounds, 1 and 0 for float positions
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+// shared with every program, filled once per frame
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec3 cameraPos;
+};
 
 void main()
 {
+	vec3 position = aPos * positionScale + positionOffset;
+
 	// resulting position of the vertex
-	gl_Position = projection * view * model * vec4(aPos.xyz, 1.0);
+	gl_Position = projection * view * model * vec4(position, 1.0);
 }
\ No newline at end of file
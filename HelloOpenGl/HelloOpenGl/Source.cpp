@@ -4,15 +4,46 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <cstdlib>
+#include <fstream>
 #include <iostream>
+#include <memory>
+#include <numeric>
 #include <string_view>
 #include <string>
+#include <tuple>
+#include <vector>
 
 #include "shader.h"
 #include "stb_image.h"
 #include "camera.h"
-
-GLFWwindow* getWindow();
+#include "benchmark.h"
+#include "instancing.h"
+#include "transform.h"
+#include "mesh.h"
+#include "vertex_format.h"
+#include "render_queue.h"
+#include "gl_state.h"
+#include "headless.h"
+#include "gpu_timer.h"
+#include "profiler.h"
+#include "thread_pool.h"
+#include "texture_loader.h"
+#include "texture_cache.h"
+#include "material_atlas.h"
+#include "texture_file.h"
+#include "texture_tool.h"
+#include "frustum.h"
+#include "bvh.h"
+#include "spatial_grid.h"
+#include "occlusion.h"
+#include "occlusion_query.h"
+
+GLFWwindow* getWindow(bool headless);
+bool hasArgument(int argc, char* argv[], std::string_view argument);
+int argumentValue(int argc, char* argv[], std::string_view argument, int fallback);
+std::string_view argumentText(int argc, char* argv[], std::string_view argument, std::string_view fallback);
 
 bool GLADstatus();
 bool shaderStatus(GLuint shader, std::string_view shader_type);
@@ -22,11 +53,26 @@ void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void processInput(GLFWwindow* window);
 void mouse_callback(GLFWwindow* window, double xpos, double ypos);
 void scroll_callback(GLFWwindow* window, double xoffset, double yoffset);
-GLuint createTexture(const char* location, GLenum textureUnit, GLenum colorFormat);
+float pointLightRange(float brightness);
 
 float width = 1200.0f;
 float height = 800.0f;
 
+constexpr float nearPlane{ 0.1f };
+constexpr float farPlane{ 100.0f };
+
+// Uniform names, constexpr so their hashes are computed by the compiler
+constexpr UniformName positionScaleUniform{ "positionScale" };
+constexpr UniformName positionOffsetUniform{ "positionOffset" };
+constexpr UniformName materialShininessUniform{ "material.shininess" };
+constexpr UniformName materialDiffuseUniform{ "material.diffuse" };
+constexpr UniformName materialSpecularUniform{ "material.specular" };
+constexpr UniformName materialDiffuseLayersUniform{ "material.diffuseLayers" };
+constexpr UniformName materialSpecularLayersUniform{ "material.specularLayers" };
+constexpr UniformName materialLayeredUniform{ "material.layered" };
+constexpr UniformName modelUniform{ "model" };
+constexpr UniformName sourceColorUniform{ "sourceColor" };
+
 // Resources
 // =========
 
@@ -89,7 +135,16 @@ constexpr glm::vec3 pointLightColors[] = {
 	glm::vec3(0.0f, 0.0f, 1.0f)
 };
 
+// light 2 is further away so it gets a stronger diffuse
+constexpr float pointLightDiffuseStrength[] = { 0.7f, 0.7f, 1.7f, 0.7f };
+
+// attenuation = 1 / (constant + linear * d + quadratic * d^2), same for every light
+constexpr float pointLightConstant{ 1.0f };
+constexpr float pointLightLinear{ 0.09f };
+constexpr float pointLightQuadratic{ 0.032f };
+
 constexpr int numOfPointLights{ 4 };
+static_assert(numOfPointLights == maxPointLights, "FragmentShader.frag always loops over NR_POINT_LIGHTS");
 
 constexpr glm::vec3 cubePositions[] = {
 	glm::vec3(0.0f,  0.0f,  0.0f),
@@ -104,7 +159,6 @@ constexpr glm::vec3 cubePositions[] = {
 	glm::vec3(-1.3f,  1.0f, -1.5f)
 };
 
-constexpr int numOfCubes{ 10 };
 constexpr int numOfTraingles{ 36 };
 
 // Non const globals
@@ -126,23 +180,81 @@ bool mouseLocked = true;
 // lighting
 glm::vec3 lightPos(1.2f, 1.0f, 2.0f);
 
-int main()
+int main(int argc, char* argv[])
 {
+	// --bench runs the micro benchmarks instead of the render loop
+	bool runBenchmarks{ hasArgument(argc, argv, "--bench") };
+	// --stats prints per frame counters once a second
+	bool printStats{ hasArgument(argc, argv, "--stats") };
+	// --stress N adds N randomly placed cubes on top of the normal scene
+	int stressCubes{ argumentValue(argc, argv, "--stress", 0) };
+	// --compact uses 16 byte vertices instead of 32 byte ones
+	VertexLayout vertexLayout{ hasArgument(argc, argv, "--compact") ? VertexLayout::Compact : VertexLayout::Float };
+	// --material-array gives the cubes different materials from texture arrays, see the textures section
+	bool materialArray{ hasArgument(argc, argv, "--material-array") };
+	// --bvh culls through the bounding volume hierarchy instead of testing every cube
+	bool cullWithBvh{ hasArgument(argc, argv, "--bvh") };
+	// --dynamic makes every cube orbit the y axis, culling and the --stats queries go through the spatial grid then
+	bool dynamicCubes{ hasArgument(argc, argv, "--dynamic") };
+	// --occlusion draws the closest cubes into a CPU depth buffer and skips the ones they hide
+	bool occlusionCulling{ hasArgument(argc, argv, "--occlusion") };
+	// --occlusion-queries draws the cubes in clusters, each behind a GPU occlusion query on its box
+	bool occlusionQueries{ hasArgument(argc, argv, "--occlusion-queries") };
+	// --headless --frames N renders N frames offscreen along a fixed camera path and prints timings as JSON
+	// --out file writes the JSON there instead of stdout. Status messages go to stderr, so stdout is only
+	// the JSON unless --stats is given too
+	bool headless{ hasArgument(argc, argv, "--headless") };
+	int headlessFrames{ argumentValue(argc, argv, "--frames", 300) };
+	std::string_view headlessOutput{ argumentText(argc, argv, "--out", "") };
+	// --gpu-log file writes the GPU time of every pass and frame there as CSV when the program ends
+	std::string_view gpuLogOutput{ argumentText(argc, argv, "--gpu-log", "") };
+	// --trace file records CPU zones and writes them there as a Chrome trace when the program ends
+	std::string_view traceOutput{ argumentText(argc, argv, "--trace", "") };
+	profiler.enabled = !traceOutput.empty();
+	profiler.nameThread("main");
+
+	// --compress image --format bc7 writes image.htex with a compressed mip chain and exits, no GL needed
+	// --filter picks the mip filter and --linear skips the sRGB conversion for data maps
+	std::string_view compressInput{ argumentText(argc, argv, "--compress", "") };
+	if (!compressInput.empty())
+	{
+		TextureColorSpace colorSpace{ hasArgument(argc, argv, "--linear") ? TextureColorSpace::Linear : TextureColorSpace::SRGB };
+		return compressTextureTool(compressInput, argumentText(argc, argv, "--format", "bc7"), argumentText(argc, argv, "--filter", "kaiser"), colorSpace);
+	}
+
+	// --bench-occlusion runs just the CPU occlusion buffer benchmark and its checks and exits, no GL needed
+	// Exits with 1 when a check fails
+	if (hasArgument(argc, argv, "--bench-occlusion"))
+		return benchOcclusion() ? 0 : 1;
+
 	// Initialization
 	// ==============
 
-	GLFWwindow* window{ getWindow() };
+	GLFWwindow* window{ getWindow(headless) };
 	// Make sure all libraries are working
 	if ((!window) || (!GLADstatus()))
 		return 1;
 
 	// Viewport size, should be same as window
-	glViewport(0, 0, static_cast<int>(width), static_cast<int>(height));
+	glState.viewport(0, 0, static_cast<int>(width), static_cast<int>(height));
 	// Bind to resize viewport on window resizing
 	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
 	glfwSetCursorPosCallback(window, mouse_callback);
 	glfwSetScrollCallback(window, scroll_callback);
 
+	// headless frames go into an FBO, nothing ever shows up on screen
+	std::unique_ptr<OffscreenTarget> offscreen;
+	if (headless)
+	{
+		offscreen = std::make_unique<OffscreenTarget>(static_cast<GLsizei>(width), static_cast<GLsizei>(height));
+		if (!offscreen->complete)
+		{
+			std::cerr << "Failed to create offscreen framebuffer\n";
+			glfwTerminate();
+			return 1;
+		}
+	}
+
 	// Get the shader program
 	Shader cubeShader("VertexShader.vert", "FragmentShader.frag");
 	Shader lightSourceShader("LightSourceVertex.vert", "LightSourceFragment.frag");
@@ -150,44 +262,257 @@ int main()
 	// Buffers
 	// =======
 	
+	// weld the duplicate vertices of the triangle list and order everything for the vertex cache
+	Mesh cubeMesh{ buildMesh(vertices, numOfTraingles, 8) };
+	GLsizei cubeIndexCount{ static_cast<GLsizei>(cubeMesh.indices.size()) };
+	VertexData cubeVertexData{ packVertices(cubeMesh, vertexLayout) };
+
 	// first we do the cubeVAO and also create universal VBO with vertices
-	GLuint VBO, cubeVAO;
+	GLuint VBO, EBO, cubeVAO;
 	glGenVertexArrays(1, &cubeVAO);
 	glGenBuffers(1, &VBO);
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
-	glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
+	glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
+	glBufferData(GL_ARRAY_BUFFER, cubeVertexData.bytes.size(), cubeVertexData.bytes.data(), GL_STATIC_DRAW);
+
+	glState.bindVertexArray(cubeVAO);
+	GLenum cubeIndexType{ uploadIndices(cubeMesh, EBO) };
 
-	glBindVertexArray(cubeVAO);
+	// position, normal and texture coordinate attribs
+	setVertexAttributes(vertexLayout);
 
-	// position attrib
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*)0);
-	glEnableVertexAttribArray(0);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*)(sizeof(float) * 3));
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*)(sizeof(float) * 6));
-	glEnableVertexAttribArray(2);
+	// model matrices of the cubes go to locations 3 to 6 and the material layer to 7, one per instance
+	InstanceBuffer cubeInstances(cubeVAO, 3);
 
 	// secondly we make the lightSourceVAO for the lightsource
 	GLuint lightSourceVAO;
 	glGenVertexArrays(1, &lightSourceVAO);
-	glBindVertexArray(lightSourceVAO);
+	glState.bindVertexArray(lightSourceVAO);
 
-	glBindBuffer(GL_ARRAY_BUFFER, VBO);
+	glState.bindBuffer(GL_ARRAY_BUFFER, VBO);
+	// the element buffer binding is part of the VAO state
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
 
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 8, (void*)0);
-	glEnableVertexAttribArray(0);
-	//glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(float) * 6, (void*)(sizeof(float) * 3));
-	//glEnableVertexAttribArray(1);
+	setVertexAttributes(vertexLayout, true);
+
+	// undo the position quantization, both shaders read the same vertices
+	for (const Shader* shader : { &cubeShader, &lightSourceShader })
+	{
+		shader->use();
+		shader->setVec3(positionScaleUniform, cubeVertexData.positionScale);
+		shader->setVec3(positionOffsetUniform, cubeVertexData.positionOffset);
+	}
 
 
 	// Textures
 	// ========
 
-	// construction of the texture is handled inside createTexture(location)
-	// just bind the texture using glBindTexture when i want to use it
-	GLuint diffuseTexture{ createTexture("container2.png", GL_TEXTURE0, GL_RGBA) };
-	GLuint specularTexture{ createTexture("container2_specular.png", GL_TEXTURE1, GL_RGBA) };
+	// decoding happens on the workers, until a texture is uploaded it's a single placeholder texel
+	// (grey diffuse, no specular) so the first frame doesn't wait for any of them
+	ThreadPool workers;
+	TextureLoader textureLoader{ workers };
+	// --texture-budget MB, unreferenced textures get evicted above it
+	int textureBudget{ argumentValue(argc, argv, "--texture-budget", static_cast<int>(defaultTextureBudget >> 20)) };
+	TextureCache textureCache{ textureLoader, static_cast<size_t>(textureBudget) << 20 };
+	// textures made with --compress are used instead of the pngs when they're there
+	TextureHandle diffuseTexture{ textureCache.acquire("container2.png", glm::vec4(0.5f, 0.5f, 0.5f, 1.0f)) };
+	TextureHandle specularTexture{ textureCache.acquire("container2_specular.png", glm::vec4(0.0f, 0.0f, 0.0f, 1.0f), TextureColorSpace::Linear) };
+
+	// --material-array packs every material into layers of two texture arrays and the cubes cycle through
+	// them, still in one draw. Built up front, so it doesn't go through the loader or the cache
+	std::unique_ptr<MaterialAtlas> materialAtlas;
+	if (materialArray)
+	{
+		materialAtlas = std::make_unique<MaterialAtlas>(workers, std::vector<MaterialTextures>{
+			{ "container2.png", "container2_specular.png" },
+			{ "container.jpg", "" },
+			{ "ajwm5.png", "" },
+			{ "images.png", "" },
+		});
+		// without layers the material index would be taken modulo 0, use the single textures instead
+		if (!materialAtlas->loaded())
+		{
+			std::cerr << "FAILED to build the material array, using the single textures\n";
+			materialAtlas.reset();
+			materialArray = false;
+		}
+	}
+
+	// every headless run has to draw the same frames
+	if (headless)
+		textureLoader.finish();
+
+
+	// Benchmarks
+	// ==========
+
+	if (runBenchmarks)
+	{
+		benchUniformLookup(cubeShader);
+		benchTransforms();
+		benchFrustumCulling();
+		benchBvh();
+		benchSpatialGrid();
+		benchOcclusion();
+		benchMeshOptimization(vertices, numOfTraingles);
+		benchTextureLoad("container2.png");
+		benchMipGeneration("container2.png");
+		glfwTerminate();
+		return 0;
+	}
+
+
+	// Uniforms
+	// ========
+
+	// every name is resolved here once, the render loop only uses the stored locations
+	UniformHandle<float> materialShininess{ cubeShader, materialShininessUniform };
+	UniformHandle<int> materialDiffuse{ cubeShader, materialDiffuseUniform };
+	UniformHandle<int> materialSpecular{ cubeShader, materialSpecularUniform };
+	UniformHandle<int> materialDiffuseLayers{ cubeShader, materialDiffuseLayersUniform };
+	UniformHandle<int> materialSpecularLayers{ cubeShader, materialSpecularLayersUniform };
+	UniformHandle<int> materialLayered{ cubeShader, materialLayeredUniform };
+
+	UniformHandle<glm::mat4> lightSourceModel{ lightSourceShader, modelUniform };
+	UniformHandle<glm::vec3> sourceColor{ lightSourceShader, sourceColorUniform };
+
+	// Set properties of material, they never change
+	cubeShader.use();
+	materialShininess.set(32.0f);
+
+	// samplers of different types can't share a unit, so whichever pair isn't used points at 2 and 3
+	materialLayered.set(materialArray ? 1 : 0);
+	materialDiffuse.set(materialArray ? 2 : 0);
+	materialSpecular.set(materialArray ? 3 : 1);
+	materialDiffuseLayers.set(materialArray ? 0 : 2);
+	materialSpecularLayers.set(materialArray ? 1 : 3);
+
+	// camera and lights live in uniform buffers that both programs read from
+	UniformBuffer<CameraBlock> cameraBuffer(CameraBinding);
+	UniformBuffer<LightsBlock> lightsBuffer(LightsBinding);
+
+
+	// Cubes
+	// =====
+
+	// the scene cubes first, then the stress cubes spread out around them
+	std::vector<glm::vec3> cubes(std::begin(cubePositions), std::end(cubePositions));
+	if (stressCubes > 0)
+	{
+		std::vector<glm::vec3> extra{ stressPositions(static_cast<size_t>(stressCubes), 50.0f) };
+		cubes.insert(cubes.end(), extra.begin(), extra.end());
+	}
+
+	// --occlusion-queries needs the cubes of a cluster next to each other in the instance buffer, so they're
+	// sorted by the cell they're in and every cell is a cluster. cubeOrder is where a cube was before,
+	// its spin and material still come from there
+	constexpr float clusterSize{ 8.0f };
+	std::vector<size_t> cubeOrder(cubes.size());
+	std::iota(cubeOrder.begin(), cubeOrder.end(), size_t{ 0 });
+	std::vector<std::uint32_t> cubeClusters(cubes.size(), 0);
+	std::uint32_t clusterCount{ 1 };
+	if (occlusionQueries)
+	{
+		auto cell = [&](glm::vec3 position) {
+			glm::ivec3 coordinate{ glm::floor(position / clusterSize) };
+			return std::tuple(coordinate.z, coordinate.y, coordinate.x);
+		};
+		std::stable_sort(cubeOrder.begin(), cubeOrder.end(), [&](size_t a, size_t b) { return cell(cubes[a]) < cell(cubes[b]); });
+		std::vector<glm::vec3> sorted(cubes.size());
+		for (size_t i{ 0 }; i < cubes.size(); i++)
+			sorted[i] = cubes[cubeOrder[i]];
+		cubes = std::move(sorted);
+
+		clusterCount = 0;
+		for (size_t i{ 0 }; i < cubes.size(); i++)
+		{
+			clusterCount += i == 0 || cell(cubes[i]) != cell(cubes[i - 1]);
+			cubeClusters[i] = clusterCount - 1;
+		}
+	}
+
+	// every cube spins around its own tilted axis, the per frame spin is shared
+	TransformBatch cubeTransforms;
+	cubeTransforms.resize(cubes.size());
+	for (size_t i{ 0 }; i < cubes.size(); i++)
+		cubeTransforms.set(i, cubes[i], glm::vec3(1.0f, 0.3f, 0.5f), glm::radians(20.0f * cubeOrder[i]));
+
+	// filled every frame, allocated once here
+	std::vector<InstanceTransform> cubeInstanceData(cubes.size());
+	if (materialAtlas)
+		for (size_t i{ 0 }; i < cubes.size(); i++)
+			cubeInstanceData[i].material = static_cast<std::uint32_t>(cubeOrder[i] % materialAtlas->layers);
+
+	// without --dynamic the cubes only spin in place, so their bounds never change. The box has to hold
+	// the cube at any rotation, which makes it the sphere's box, the sphere does the work here
+	const float cubeRadius{ std::sqrt(3.0f) * 0.5f };
+	BoundsBatch cubeBounds;
+	cubeBounds.resize(cubes.size());
+	for (size_t i{ 0 }; i < cubes.size(); i++)
+		cubeBounds.set(i, cubes[i], cubeRadius, glm::vec3(cubeRadius));
+
+	// the same boxes in a BVH, for --bvh culling and the picking and light queries --stats prints
+	std::vector<Aabb> cubeBoxes(cubes.size());
+	for (size_t i{ 0 }; i < cubes.size(); i++)
+		cubeBoxes[i] = Aabb::around(cubes[i], glm::vec3(cubeRadius));
+	Bvh cubeBvh;
+	cubeBvh.build(cubeBoxes);
+	// moving cubes would have to rebuild the BVH every frame, the grid only changes when one crosses into another cell
+	SpatialGrid cubeGrid;
+	if (dynamicCubes)
+		cubeGrid.build(cubeBoxes);
+	std::vector<std::uint32_t> lightReach;
+
+	// indices of the cubes that survive culling and their instances, packed for the upload
+	std::vector<std::uint32_t> visibleCubes(cubes.size());
+	std::vector<InstanceTransform> visibleInstanceData(cubes.size());
+	size_t visibleCubeCount{ 0 };
+
+	// the closest cubes that passed the frustum are the occluders, the rest of them get tested
+	constexpr size_t maxOccluders{ 32 };
+	OcclusionBuffer occlusion;
+	std::vector<std::uint32_t> occluders;
+
+	// with --occlusion-queries the visible cubes of a cluster are a run of the instance upload, one draw each
+	struct ClusterDraw
+	{
+		std::uint32_t cluster;
+		std::uint32_t first;
+		std::uint32_t count;
+		Aabb box;
+		float distance;
+	};
+	std::vector<ClusterDraw> clusterDraws;
+	OcclusionQueries cubeQueries;
+	cubeQueries.resize(clusterCount);
+
+	// every draw goes through the queue, it sorts them to change as little state as possible
+	RenderQueue renderQueue;
+
+	// GPU time of the cube and light source draws
+	GpuTimer gpuTimer;
+	int cubePass{ gpuTimer.pass("cubes") };
+	int lightSourcePass{ gpuTimer.pass("light_sources") };
+
+	DrawCall cubeDraw;
+	cubeDraw.shader = &cubeShader;
+	cubeDraw.vao = cubeVAO;
+	cubeDraw.textures[0] = materialAtlas ? materialAtlas->diffuse : diffuseTexture.id();
+	cubeDraw.textures[1] = materialAtlas ? materialAtlas->specular : specularTexture.id();
+	cubeDraw.textureTarget = materialAtlas ? GL_TEXTURE_2D_ARRAY : GL_TEXTURE_2D;
+	cubeDraw.indexCount = cubeIndexCount;
+	cubeDraw.indexType = cubeIndexType;
+	cubeDraw.instanceCount = 0; // set every frame to what survives culling
+	cubeDraw.gpuPass = cubePass;
+
+	DrawCall lightSourceDraw;
+	lightSourceDraw.shader = &lightSourceShader;
+	lightSourceDraw.vao = lightSourceVAO;
+	lightSourceDraw.indexCount = cubeIndexCount;
+	lightSourceDraw.indexType = cubeIndexType;
+	lightSourceDraw.model = lightSourceModel;
+	lightSourceDraw.color = sourceColor;
+	lightSourceDraw.gpuPass = lightSourcePass;
 
 
 	// Render loop
@@ -196,158 +521,420 @@ int main()
 	glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
 	// Set which color the window will turn into when cleared
-	glEnable(GL_DEPTH_TEST);
+	glState.enable(GL_DEPTH_TEST);
 
 	// Debug thing do draw in wire frame mode
 	//glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
+	float lastStatsPrint{ 0.0f };
+	int framesSinceStats{ 0 };
+
+	FrameProfile frameProfile;
+	int frame{ 0 };
+
 	while (!glfwWindowShouldClose(window))
 	{
-		// Get input to close window
-		processInput(window);
-		camera.ProcessKeyboard(window, deltaTime);
+		if (headless && frame >= headlessWarmupFrames + headlessFrames)
+			break;
+
+		PROFILE_ZONE("frame");
+		frameProfile.beginFrame();
+		gpuTimer.beginFrame();
+		uniformStats = {};
+		glState.stats = {};
 
-		// Calculate deltaTime
-		float currentFrame{ static_cast<float>(glfwGetTime()) };
+		// Calculate deltaTime, headless runs step a fixed amount so every run draws the same frames
+		float currentFrame{ headless ? frame * headlessTimeStep : static_cast<float>(glfwGetTime()) };
 		deltaTime = currentFrame - lastFrame;
 		lastFrame = currentFrame;
 
+		if (headless)
+		{
+			PROFILE_ZONE("camera path");
+			CameraPose pose{ cameraPathPose(frame) };
+			camera.SetPose(pose.position, pose.yaw, pose.pitch);
+		}
+		else
+		{
+			PROFILE_ZONE("input");
+			// Get input to close window
+			processInput(window);
+			camera.ProcessKeyboard(window, deltaTime);
+		}
+		frameProfile.mark(SectionUpdate);
+
+		textureCache.update();
+
 		// Clear screen and use background color
-		glClearColor(0.2f, 0.3f, 0.5f, 1.0f);
-		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		{
+			PROFILE_ZONE("clear");
+			glClearColor(0.2f, 0.3f, 0.5f, 1.0f);
+			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+		}
 
 		// Rendering
 		// =========
 
-		// first i activate the shader for other cubes
-		cubeShader.use();
-
-		// Set properties of material
-		cubeShader.setFloat("material.shininess", 32.0f);
-
-		cubeShader.setInt("material.diffuse", 0);
-		cubeShader.setInt("material.specular", 1);
-		
-		glActiveTexture(GL_TEXTURE0);
-		glBindTexture(GL_TEXTURE_2D, diffuseTexture);
-		glActiveTexture(GL_TEXTURE1);
-		glBindTexture(GL_TEXTURE_2D, specularTexture);
-
-
 		// Set properties of light
 		// =======================
 
-		// Direction Light
-
-		glm::vec3 dirLightColor = glm::vec3(1.0f);
-		glm::vec3 dirDiffuseColor = dirLightColor * glm::vec3(0.7f);
-		glm::vec3 dirAmbientColor = dirDiffuseColor * glm::vec3(0.15f);
-
-		cubeShader.setVec3("dirLight.direction", -0.2f, -1.0f, -0.3f);
-		cubeShader.setVec3("dirLight.diffuse", dirDiffuseColor);
-		cubeShader.setVec3("dirLight.ambient", dirAmbientColor);
-		cubeShader.setVec3("dirLight.specular", 0.5f, 0.5f, 0.5f);
-
-		// Point Light
-		
-		cubeShader.setVec3("pointLights[0].position", pointLightPositions[0]);
-
-		cubeShader.setVec3("pointLights[0].constant", 1.0f);
-		cubeShader.setFloat("pointLights[0].linear", 0.09f);
-		cubeShader.setFloat("pointLights[0].quadratic", 0.032f);
-
-		cubeShader.setVec3("pointLights[0].ambient", pointLightColors[0] * 0.015f);
-		cubeShader.setVec3("pointLights[0].diffuse", pointLightColors[0] * 0.7f);
-		cubeShader.setVec3("pointLights[0].specular", pointLightColors[0] * 1.0f);
-
-
-		cubeShader.setVec3("pointLights[1].position", pointLightPositions[1]);
-
-		cubeShader.setVec3("pointLights[1].constant", 1.0f);
-		cubeShader.setFloat("pointLights[1].linear", 0.09f);
-		cubeShader.setFloat("pointLights[1].quadratic", 0.032f);
-
-		cubeShader.setVec3("pointLights[1].ambient", pointLightColors[1] * 0.015f);
-		cubeShader.setVec3("pointLights[1].diffuse", pointLightColors[1] * 0.7f);
-		cubeShader.setVec3("pointLights[1].specular", pointLightColors[1] * 1.0f);
+		{
+			PROFILE_ZONE("light uniforms");
 
+			// Direction Light
 
-		cubeShader.setVec3("pointLights[2].position", pointLightPositions[2]);
+			glm::vec3 dirLightColor = glm::vec3(1.0f);
+			glm::vec3 dirDiffuseColor = dirLightColor * glm::vec3(0.7f);
+			glm::vec3 dirAmbientColor = dirDiffuseColor * glm::vec3(0.15f);
 
-		cubeShader.setVec3("pointLights[2].constant", 1.0f);
-		cubeShader.setFloat("pointLights[2].linear", 0.09f);
-		cubeShader.setFloat("pointLights[2].quadratic", 0.032f);
+			DirLightBlock& dirLight{ lightsBuffer.data.dirLight };
+			dirLight.direction = glm::vec3(-0.2f, -1.0f, -0.3f);
+			dirLight.diffuse = dirDiffuseColor;
+			dirLight.ambient = dirAmbientColor;
+			dirLight.specular = glm::vec3(0.5f);
 
-		cubeShader.setVec3("pointLights[2].ambient", pointLightColors[2] * 0.015f);
-		cubeShader.setVec3("pointLights[2].diffuse", pointLightColors[2] * 1.7f);
-		cubeShader.setVec3("pointLights[2].specular", pointLightColors[2] * 1.0f);
+			// Point Light
 
+			for (int i{ 0 }; i < numOfPointLights; i++)
+			{
+				PointLightBlock& pointLight{ lightsBuffer.data.pointLights[i] };
+				pointLight.position = pointLightPositions[i];
 
-		cubeShader.setVec3("pointLights[3].position", pointLightPositions[3]);
+				pointLight.constant = pointLightConstant;
+				pointLight.linear = pointLightLinear;
+				pointLight.quadratic = pointLightQuadratic;
 
-		cubeShader.setVec3("pointLights[3].constant", 1.0f);
-		cubeShader.setFloat("pointLights[3].linear", 0.09f);
-		cubeShader.setFloat("pointLights[3].quadratic", 0.032f);
+				pointLight.ambient = pointLightColors[i] * 0.015f;
+				pointLight.diffuse = pointLightColors[i] * pointLightDiffuseStrength[i];
+				pointLight.specular = pointLightColors[i] * 1.0f;
+			}
 
-		cubeShader.setVec3("pointLights[3].ambient", pointLightColors[3] * 0.015f);
-		cubeShader.setVec3("pointLights[3].diffuse", pointLightColors[3] * 0.7f);
-		cubeShader.setVec3("pointLights[3].specular", pointLightColors[3] * 1.0f);
+			lightsBuffer.upload();
+		}
 
 		// Math
 		// ====
 
-		// View/Projection transformations
-		glm::mat4 projection = glm::perspective(glm::radians(fov), width / height, 0.1f, 100.0f);
-		glm::mat4 view = camera.GetViewMatrix();
+		Frustum frustum;
+		glm::mat4 viewProjection;
+		{
+			PROFILE_ZONE("camera update");
+
+			// View/Projection transformations
+			glm::mat4 projection = glm::perspective(glm::radians(fov), width / height, nearPlane, farPlane);
+			glm::mat4 view = camera.GetViewMatrix();
 
-		cubeShader.setMat4("view", view);
-		cubeShader.setMat4("projection", projection);
-		cubeShader.setVec3("cameraPos", camera.Position.x, camera.Position.y, camera.Position.z);
+			cameraBuffer.data.view = view;
+			cameraBuffer.data.projection = projection;
+			cameraBuffer.data.position = camera.Position;
+			cameraBuffer.upload();
+
+			viewProjection = projection * view;
+			frustum = extractFrustum(viewProjection);
+		}
+		frameProfile.mark(SectionUniforms);
 
 		// world transformation
 		glm::mat4 model = glm::mat4(1.0f);
 		//cubeShader.setMat4("model", model);
 
+		renderQueue.clear();
 
-		// DRAW all cubes
-		for (unsigned int i{ 0 }; i < numOfCubes; i++)
+		if (dynamicCubes)
 		{
-			model = glm::mat4(1.0f);
-			model = glm::translate(model, cubePositions[i]);
-			float angle{ 20.0f * i };
-			model = glm::rotate(model, glm::radians(angle), glm::vec3(1.0f, 0.3f, 0.5f));
-			model = glm::rotate(model, (float)glfwGetTime() * glm::radians(50.0f), glm::vec3(0.5f, 1.0f, 0.0f));
-			cubeShader.setMat4("model", model);
-
-			glBindVertexArray(cubeVAO);
-			glDrawArrays(GL_TRIANGLES, 0, numOfTraingles);
+			PROFILE_ZONE("cube motion");
+			// everything turns around the y axis at the same rate, the outer cubes move the fastest
+			float orbit{ currentFrame * 0.1f };
+			float c{ std::cos(orbit) };
+			float s{ std::sin(orbit) };
+			for (size_t i{ 0 }; i < cubes.size(); i++)
+			{
+				glm::vec3 position(c * cubes[i].x + s * cubes[i].z, cubes[i].y, c * cubes[i].z - s * cubes[i].x);
+				cubeTransforms.x[i] = position.x;
+				cubeTransforms.z[i] = position.z;
+				cubeBounds.x[i] = position.x;
+				cubeBounds.z[i] = position.z;
+				cubeBoxes[i] = Aabb::around(position, glm::vec3(cubeRadius));
+				cubeGrid.update(static_cast<std::uint32_t>(i), cubeBoxes[i]);
+			}
+		}
+
+		// all cubes, one instanced draw for all of them
+		{
+			PROFILE_ZONE("instance transforms");
+			float spin{ currentFrame * glm::radians(50.0f) };
+			glm::mat3 sharedSpin{ glm::rotate(glm::mat4(1.0f), spin, glm::vec3(0.5f, 1.0f, 0.0f)) };
+			composeModels(cubeTransforms, sharedSpin, cubeInstanceData.data());
+		}
+		{
+			PROFILE_ZONE("frustum culling");
+			if (dynamicCubes)
+			{
+				visibleCubes.clear();
+				cubeGrid.queryFrustum(frustum, cubeBoxes, visibleCubes);
+				visibleCubeCount = visibleCubes.size();
+			}
+			else if (cullWithBvh)
+			{
+				visibleCubes.clear();
+				cubeBvh.queryFrustum(frustum, cubeBoxes, visibleCubes);
+				visibleCubeCount = visibleCubes.size();
+			}
+			else
+			{
+				visibleCubeCount = cullBounds(frustum, cubeBounds, visibleCubes.data());
+			}
+		}
+		if (occlusionCulling)
+		{
+			PROFILE_ZONE("occlusion culling");
+			auto distance = [&](std::uint32_t cube) {
+				glm::vec3 offset{ cubeBoxes[cube].center() - camera.Position };
+				return glm::dot(offset, offset);
+			};
+			occluders.assign(visibleCubes.begin(), visibleCubes.begin() + visibleCubeCount);
+			size_t occluderCount{ std::min(maxOccluders, occluders.size()) };
+			std::nth_element(occluders.begin(), occluders.begin() + occluderCount, occluders.end(),
+				[&](std::uint32_t a, std::uint32_t b) { return distance(a) < distance(b); });
+
+			occlusion.begin(viewProjection);
+			for (size_t i{ 0 }; i < occluderCount; i++)
+				occlusion.addBox(cubeInstanceData[occluders[i]].model);
+			occlusion.rasterize(&workers);
+
+			// the occluders are tested too, they just never hide themselves
+			size_t kept{ 0 };
+			for (size_t i{ 0 }; i < visibleCubeCount; i++)
+			{
+				visibleCubes[kept] = visibleCubes[i];
+				kept += occlusion.visible(cubeBoxes[visibleCubes[i]]);
+			}
+			visibleCubeCount = kept;
+		}
+		// the BVH and the grid hand the cubes back in any order, the clusters need them sorted
+		if (occlusionQueries && (dynamicCubes || cullWithBvh))
+			std::sort(visibleCubes.begin(), visibleCubes.begin() + visibleCubeCount);
+		// the batch sorts by its nearest cube
+		float nearestCube{ farPlane };
+		{
+			PROFILE_ZONE("instance upload");
+			// the material layer travels with the instance
+			for (size_t i{ 0 }; i < visibleCubeCount; i++)
+			{
+				visibleInstanceData[i] = cubeInstanceData[visibleCubes[i]];
+				nearestCube = std::min(nearestCube, glm::dot(glm::vec3(visibleInstanceData[i].model[3]) - camera.Position, camera.Front));
+			}
+			cubeInstances.upload(visibleInstanceData.data(), visibleCubeCount);
 		}
+		frameProfile.mark(SectionTransforms);
 
-		// DRAW the lightsource, we need to use a different VAO and different Shader
-		lightSourceShader.use();
-		lightSourceShader.setMat4("projection", projection);
-		lightSourceShader.setMat4("view", view);
+		cubeDraw.instanceCount = static_cast<GLsizei>(visibleCubeCount);
+		if (visibleCubeCount > 0 && !occlusionQueries)
+			renderQueue.submit(cubeDraw, nearestCube - cubeRadius, farPlane);
 
+		// or the clusters, drawn after the queue
+		if (occlusionQueries)
+		{
+			clusterDraws.clear();
+			for (size_t i{ 0 }; i < visibleCubeCount; i++)
+			{
+				std::uint32_t cluster{ cubeClusters[visibleCubes[i]] };
+				if (clusterDraws.empty() || clusterDraws.back().cluster != cluster)
+					clusterDraws.push_back({ cluster, static_cast<std::uint32_t>(i), 0, Aabb{}, 0.0f });
+				clusterDraws.back().count++;
+				clusterDraws.back().box.grow(cubeBoxes[visibleCubes[i]]);
+			}
+			// front to back, the close clusters are the ones that hide the others
+			for (ClusterDraw& cluster : clusterDraws)
+			{
+				glm::vec3 offset{ glm::clamp(camera.Position, cluster.box.min, cluster.box.max) - camera.Position };
+				cluster.distance = glm::dot(offset, offset);
+			}
+			std::sort(clusterDraws.begin(), clusterDraws.end(), [](const ClusterDraw& a, const ClusterDraw& b) { return a.distance < b.distance; });
+		}
+
+		// the lightsources, they use a different VAO and different Shader
 		for (unsigned int i{ 0 }; i < numOfPointLights; i++)
 		{
 			glm::vec3 color = pointLightColors[i];
 			glm::vec3 pos = pointLightPositions[i];
+			// the light cube is scaled to 0.3
+			if (!sphereInFrustum(frustum, pos, cubeRadius * 0.3f))
+				continue;
 
 			model = glm::mat4(1.0f);
 			model = glm::translate(model, pos);
 			model = glm::scale(model, glm::vec3(0.3f));
-			lightSourceShader.setMat4("model", model);
-			lightSourceShader.setVec3("sourceColor", color);
+			lightSourceDraw.modelValue = model;
+			lightSourceDraw.colorValue = color;
+
+			renderQueue.submit(lightSourceDraw, glm::dot(pos - camera.Position, camera.Front), farPlane);
+		}
+
+		// DRAW everything
+		renderQueue.sort();
+		frameProfile.mark(SectionSubmit);
+		{
+			PROFILE_ZONE("render queue execute");
+			renderQueue.execute(&gpuTimer);
+		}
+		if (occlusionQueries)
+		{
+			PROFILE_ZONE("cube clusters");
+			gpuTimer.begin(cubePass);
+			cubeQueries.beginFrame();
+
+			auto bindCubes = [&]() {
+				cubeShader.use();
+				for (int unit{ 0 }; unit < maxDrawTextures; unit++)
+					glState.bindTexture(unit, cubeDraw.textureTarget, cubeDraw.textures[unit]);
+				glState.bindVertexArray(cubeVAO);
+			};
+			auto drawCluster = [&](const ClusterDraw& cluster) {
+				cubeInstances.setFirstInstance(cubeVAO, cluster.first);
+				glDrawElementsInstanced(GL_TRIANGLES, cubeDraw.indexCount, cubeDraw.indexType, nullptr, cluster.count);
+			};
+
+			// the clusters that were visible, they fill the depth buffer the proxies are tested against
+			// A box the camera is in (or nearly, the near plane cuts it) can't be tested, so it's visible
+			bindCubes();
+			for (const ClusterDraw& cluster : clusterDraws)
+			{
+				glm::vec3 reach{ nearPlane * 2.0f };
+				if (glm::all(glm::greaterThan(camera.Position, cluster.box.min - reach)) && glm::all(glm::lessThan(camera.Position, cluster.box.max + reach)))
+					cubeQueries.assumeVisible(cluster.cluster);
+				if (cubeQueries.trusted(cluster.cluster))
+					cubeQueries.draw(cluster.cluster, [&]() { drawCluster(cluster); });
+			}
+
+			// boxes of the ones up for a test, drawn with the light source program since it only needs positions
+			cubeQueries.beginProxies();
+			lightSourceShader.use();
+			glState.bindVertexArray(lightSourceVAO);
+			for (const ClusterDraw& cluster : clusterDraws)
+			{
+				if (!cubeQueries.needsQuery(cluster.cluster) || cubeQueries.trusted(cluster.cluster))
+					continue;
+				// the cube mesh is a unit cube around the origin
+				glm::mat4 box{ glm::translate(glm::mat4(1.0f), cluster.box.center()) };
+				lightSourceModel.set(glm::scale(box, cluster.box.max - cluster.box.min));
+				cubeQueries.query(cluster.cluster, [&]() { glDrawElements(GL_TRIANGLES, cubeIndexCount, cubeIndexType, nullptr); });
+			}
+			cubeQueries.endProxies();
+
+			// the rest only where their box passed, or the last box they had when the result isn't back yet
+			bindCubes();
+			for (const ClusterDraw& cluster : clusterDraws)
+			{
+				if (!cubeQueries.trusted(cluster.cluster))
+					cubeQueries.draw(cluster.cluster, [&]() { drawCluster(cluster); });
+			}
+		}
+		gpuTimer.endFrame();
+		frameProfile.mark(SectionExecute);
 
-			glBindVertexArray(lightSourceVAO);
-			glDrawArrays(GL_TRIANGLES, 0, 36);
+
+		framesSinceStats++;
+		if (printStats && currentFrame - lastStatsPrint >= 1.0f)
+		{
+			float frameTime{ (currentFrame - lastStatsPrint) / framesSinceStats };
+			std::cout << cubes.size() << " cubes, " << frameTime * 1000.0f << " ms per frame\n";
+			const char* culling{ dynamicCubes ? "grid" : cullWithBvh ? "BVH" : frustumKernelName() };
+			std::cout << "Culling (" << culling << "): " << visibleCubeCount << " cubes visible, " << cubes.size() - visibleCubeCount << " culled\n";
+			if (occlusionCulling)
+			{
+				std::cout << "Occlusion (" << occlusionKernelName() << "): " << occlusion.stats.occluders << " occluders, " << occlusion.stats.triangles << " triangles, ";
+				std::cout << occlusion.stats.occluded << " of " << occlusion.stats.tested << " cubes hidden\n";
+			}
+			if (occlusionQueries)
+			{
+				const OcclusionQueryStats& queries{ cubeQueries.stats };
+				std::cout << "Occlusion queries: " << clusterDraws.size() << " of " << cubeQueries.size() << " clusters in view, " << queries.plainDraws << " drawn plainly, ";
+				std::cout << queries.conditionalDraws << " conditionally, " << queries.queriesIssued << " queries issued, " << queries.resultsRead << " read back, " << queries.hidden << " clusters hidden\n";
+			}
+			// the BVH and the grid answer the same queries
+			auto printQueries = [&](const auto& index) {
+				RayHit picked{ index.raycast(camera.Position, camera.Front, cubeBoxes, farPlane) };
+				if (picked.hit())
+					std::cout << "Looking at cube " << picked.index << ", " << picked.distance << " away\n";
+				std::cout << "Cubes lit by point lights:";
+				for (int i{ 0 }; i < numOfPointLights; i++)
+				{
+					lightReach.clear();
+					index.querySphere(pointLightPositions[i], pointLightRange(pointLightDiffuseStrength[i]), cubeBoxes, lightReach);
+					std::cout << ' ' << lightReach.size();
+				}
+				std::cout << '\n';
+			};
+			if (dynamicCubes)
+			{
+				printQueries(cubeGrid);
+				std::cout << "Grid: " << cubeGrid.cellCount() << " cells, " << cubeGrid.cellChanges() << " cell changes\n";
+			}
+			else
+			{
+				printQueries(cubeBvh);
+			}
+			std::cout << "Uniform uploads: " << uniformStats.issued << " issued, " << uniformStats.elided << " elided\n";
+			std::cout << "GL state calls: " << glState.stats.issued << " issued, " << glState.stats.elided << " elided\n";
+			std::cout << "Draws: " << renderQueue.stats.draws << ", program changes: " << renderQueue.stats.programChanges;
+			std::cout << ", texture changes: " << renderQueue.stats.textureChanges << ", VAO changes: " << renderQueue.stats.vaoChanges << '\n';
+			const TextureCacheStats& textureStats{ textureCache.statistics() };
+			std::cout << "Textures: " << textureStats.textures << " (" << textureStats.residentBytes / 1024 << " KB), " << textureLoader.pending() << " loading, ";
+			std::cout << textureStats.hits << " hits, " << textureStats.misses << " misses, " << textureStats.evictions << " evictions\n";
+			std::cout << "GPU: cubes " << gpuTimer.average(cubePass) << " ms, light sources " << gpuTimer.average(lightSourcePass) << " ms\n";
+			lastStatsPrint = currentFrame;
+			framesSinceStats = 0;
+		}
+
+		if (headless)
+		{
+			PROFILE_ZONE("glFinish");
+			// nothing to swap, wait for the GPU instead so the frame time includes its work
+			glFinish();
+		}
+		else
+		{
+			PROFILE_ZONE("swap buffers");
+			// Swap buffers every frame to switch the image
+			glfwSwapBuffers(window);
+		}
+		{
+			PROFILE_ZONE("poll events");
+			// lotta stuff
+			glfwPollEvents();
 		}
 
+		frameProfile.mark(SectionPresent);
+		frameProfile.endFrame(headless && frame >= headlessWarmupFrames);
+		frame++;
+	}
+
+	gpuTimer.flush();
 
-		// Swap buffers every frame to switch the image
-		glfwSwapBuffers(window);
-		// lotta stuff
-		glfwPollEvents();
+	if (headless)
+	{
+		if (headlessOutput.empty())
+		{
+			frameProfile.writeJson(std::cout, cubes.size(), gpuTimer);
+		}
+		else
+		{
+			std::ofstream output{ std::string(headlessOutput) };
+			frameProfile.writeJson(output, cubes.size(), gpuTimer);
+		}
+	}
+
+	if (!gpuLogOutput.empty())
+	{
+		std::ofstream output{ std::string(gpuLogOutput) };
+		gpuTimer.writeLog(output);
+	}
+
+	if (!traceOutput.empty())
+	{
+		std::ofstream output{ std::string(traceOutput) };
+		profiler.writeChromeTrace(output);
 	}
 
 
@@ -361,10 +948,18 @@ int main()
 	return 0;
 }
 
-GLFWwindow* getWindow()
+GLFWwindow* getWindow(bool headless)
 {
 	// Initialize glfw
-	glfwInit();
+	// headless asks for the null platform, it needs no display and gets its context from OSMesa
+	if (headless)
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+	if (!glfwInit() && headless)
+	{
+		// GLFW built without the null platform, an invisible window on the normal one will do
+		glfwInitHint(GLFW_PLATFORM, GLFW_ANY_PLATFORM);
+		glfwInit();
+	}
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
 	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
@@ -373,13 +968,26 @@ GLFWwindow* getWindow()
 	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+	if (headless)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+		if (glfwGetPlatform() == GLFW_PLATFORM_NULL)
+			glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+	}
+
 	// Create window and opengl context
 	GLFWwindow* window{ glfwCreateWindow(static_cast<int>(width), static_cast<int>(height), "second attempt vro", nullptr, nullptr)};
+	if (!window && headless)
+	{
+		// no OSMesa, try EGL which also works without a display on Mesa
+		glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+		window = glfwCreateWindow(static_cast<int>(width), static_cast<int>(height), "second attempt vro", nullptr, nullptr);
+	}
 
 	// Check for successful creation
 	if (!window)
 	{
-		std::cout << "Failed to create glfwWindow\n";
+		std::cerr << "Failed to create glfwWindow\n";
 		glfwTerminate();
 		return nullptr;
 	}
@@ -390,15 +998,56 @@ GLFWwindow* getWindow()
 	return window;
 }
 
+// Distance where a point light of the given diffuse strength fades below 5/256, nothing past it is lit noticeably
+float pointLightRange(float brightness)
+{
+	// solve constant + linear * d + quadratic * d^2 = brightness * 256 / 5 for d
+	float c{ pointLightConstant - brightness * 256.0f / 5.0f };
+	return (-pointLightLinear + std::sqrt(pointLightLinear * pointLightLinear - 4.0f * pointLightQuadratic * c)) / (2.0f * pointLightQuadratic);
+}
+
+// True if argument was passed on the command line
+bool hasArgument(int argc, char* argv[], std::string_view argument)
+{
+	for (int i{ 1 }; i < argc; i++)
+	{
+		if (argument == argv[i])
+			return true;
+	}
+	return false;
+}
+
+// Text following argument on the command line, fallback if it's missing
+std::string_view argumentText(int argc, char* argv[], std::string_view argument, std::string_view fallback)
+{
+	for (int i{ 1 }; i + 1 < argc; i++)
+	{
+		if (argument == argv[i])
+			return argv[i + 1];
+	}
+	return fallback;
+}
+
+// Number following argument on the command line, fallback if it's missing
+int argumentValue(int argc, char* argv[], std::string_view argument, int fallback)
+{
+	for (int i{ 1 }; i + 1 < argc; i++)
+	{
+		if (argument == argv[i])
+			return std::atoi(argv[i + 1]);
+	}
+	return fallback;
+}
+
 // GLAD finds locations of opengl functions on the pc
 bool GLADstatus()
 {
 	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
 	{
-		std::cout << "Failed to initialize GLAD" << std::endl;
+		std::cerr << "Failed to initialize GLAD" << std::endl;
 		return false;
 	}
-	std::cout << "GLAD working\n";
+	std::cerr << "GLAD working\n";
 	return true;
 }
 
@@ -407,7 +1056,7 @@ void framebuffer_size_callback(GLFWwindow* window, int new_width, int new_height
 {
 	width = static_cast<float>(new_width);
 	height = static_cast<float>(new_height);
-	glViewport(0, 0, new_width, new_height);
+	glState.viewport(0, 0, new_width, new_height);
 }
 
 bool wasEscPressed = false;
@@ -451,38 +1100,6 @@ void processInput(GLFWwindow* window)
 	}
 }
 
-GLuint createTexture(const char* location, GLenum textureUnit, GLenum colorFormat)
-{
-	stbi_set_flip_vertically_on_load(true);
-
-	GLuint texture;
-	glGenTextures(1, &texture);
-	glActiveTexture(textureUnit);
-	glBindTexture(GL_TEXTURE_2D, texture);
-	
-	// Texture wrapping and filtering options
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-	// Generate image
-	int width, height, nrChannels;
-	unsigned char* data = stbi_load(location, &width, &height, &nrChannels, 0);
-	if (data)
-	{
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, colorFormat, GL_UNSIGNED_BYTE, data);
-		glGenerateMipmap(GL_TEXTURE_2D);
-	}
-	else
-	{
-		std::cout << "FAILED to create texture\n";
-	}
-	stbi_image_free(data);
-
-	return texture;
-}
-
 void mouse_callback(GLFWwindow* window, double xposIn, double yposIn)
 {
 	
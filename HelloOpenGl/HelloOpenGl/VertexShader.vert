@@ -3,27 +3,44 @@
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoord;
+// per instance, from the instance buffer
+// only ever rotation and translation, so mat3(model) is its own normal matrix
+layout (location = 3) in mat4 model;
+// texture array layer of the cube's material, 0 without --material-array
+layout (location = 7) in uint materialLayer;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// decodes positions quantized to the mesh bounds, 1 and 0 for float positions
+uniform vec3 positionScale;
+uniform vec3 positionOffset;
+
+// shared with every program, filled once per frame
+layout (std140) uniform Camera
+{
+	mat4 view;
+	mat4 projection;
+	vec3 cameraPos;
+};
 
 out vec2 TexCoord;
 out vec3 FragPos;
 out vec3 Normal;
+flat out uint MaterialLayer;
 
 void main()
 {
+	vec3 position = aPos * positionScale + positionOffset;
+
 	// resulting position of the vertex
-	gl_Position = projection * view * model * vec4(aPos.xyz, 1.0);
+	gl_Position = projection * view * model * vec4(position, 1.0);
 
 	// Pass location of the fragment in world space
-	FragPos = vec3(model * vec4(aPos, 1.0));
+	FragPos = vec3(model * vec4(position, 1.0));
 
 	// Change the normal according to its model matrixCompMult
 	// so rotating the model matrix rotates the normal
-	Normal = mat3(transpose(inverse(model))) * aNormal;
+	Normal = mat3(model) * aNormal;
 
 	// Pass texture coordinates
 	TexCoord = aTexCoord;
+	MaterialLayer = materialLayer;
 }
@@ -0,0 +1,602 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "shader.h"
+#include "instancing.h"
+#include "transform.h"
+#include "frustum.h"
+#include "bvh.h"
+#include "spatial_grid.h"
+#include "occlusion.h"
+#include "thread_pool.h"
+#include "mesh.h"
+#include "gl_state.h"
+#include "mapped_file.h"
+#include "mip_generator.h"
+#include "stb_image.h"
+#include "texture_file.h"
+#include "texture_tool.h"
+
+// Micro benchmarks, run with --bench
+// Most need a current GL context, so main() calls them after setting everything up. benchOcclusion
+// doesn't, --bench-occlusion runs it on its own before any window is made
+
+// Average nanoseconds per call of func over the given number of iterations
+template <typename Func>
+double timeNanoseconds(int iterations, Func func)
+{
+	auto start{ std::chrono::steady_clock::now() };
+	for (int i{ 0 }; i < iterations; i++)
+		func(i);
+	auto end{ std::chrono::steady_clock::now() };
+	return std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+}
+
+// glGetUniformLocation against the table Shader builds at link time
+void benchUniformLookup(const Shader& shader, int iterations = 1000000)
+{
+	std::vector<std::string> names;
+	shader.uniforms.forEach([&](const std::string& name, GLint) { names.push_back(name); });
+	if (names.empty())
+		return;
+
+	// write the results somewhere so the calls can't be optimised away
+	volatile GLint sink{ 0 };
+
+	double driver{ timeNanoseconds(iterations, [&](int i) {
+		sink = glGetUniformLocation(shader.ID, names[i % names.size()].c_str());
+	}) };
+
+	double table{ timeNanoseconds(iterations, [&](int i) {
+		sink = shader.location(names[i % names.size()]);
+	}) };
+
+	std::cout << "Uniform lookup (" << names.size() << " names, " << iterations << " lookups)\n";
+	std::cout << "  glGetUniformLocation: " << driver << " ns\n";
+	std::cout << "  UniformTable:         " << table << " ns\n";
+}
+
+// Per frame cube model matrices, glm::translate/rotate per cube against the batch kernel
+void benchTransforms()
+{
+	const glm::vec3 axis(1.0f, 0.3f, 0.5f);
+	const glm::vec3 spinAxis(0.5f, 1.0f, 0.0f);
+	const float spin{ 1.0f };
+
+	std::cout << "Model matrices (batch kernel: " << transformKernelName() << ")\n";
+
+	for (size_t count : { size_t{ 1000 }, size_t{ 100000 }, size_t{ 1000000 } })
+	{
+		std::vector<glm::vec3> positions{ stressPositions(count, 50.0f) };
+		std::vector<InstanceTransform> instances(count);
+
+		TransformBatch batch;
+		batch.resize(count);
+		for (size_t i{ 0 }; i < count; i++)
+			batch.set(i, positions[i], axis, glm::radians(20.0f * i));
+
+		int frames{ static_cast<int>(10000000 / count) + 1 };
+
+		double glmTime{ timeNanoseconds(frames, [&](int) {
+			for (size_t i{ 0 }; i < count; i++)
+			{
+				glm::mat4 model{ glm::translate(glm::mat4(1.0f), positions[i]) };
+				model = glm::rotate(model, glm::radians(20.0f * i), axis);
+				model = glm::rotate(model, spin, spinAxis);
+				instances[i].model = model;
+			}
+		}) };
+
+		double batchTime{ timeNanoseconds(frames, [&](int) {
+			glm::mat3 shared{ glm::rotate(glm::mat4(1.0f), spin, spinAxis) };
+			composeModels(batch, shared, instances.data());
+		}) };
+
+		std::cout << "  " << count << " instances: glm " << glmTime / 1e6 << " ms, batch " << batchTime / 1e6 << " ms (";
+		std::cout << glmTime / batchTime << "x)\n";
+	}
+}
+
+// The culling benchmarks all look from the origin down -z, at count cubes spread 50 units around it
+struct BenchScene
+{
+	glm::mat4 viewProjection;
+	Frustum frustum;
+	std::vector<glm::vec3> positions;
+	std::vector<Aabb> boxes;
+};
+
+// Bounding sphere of a unit cube, its box is this big on every axis too
+const float benchCubeRadius{ std::sqrt(3.0f) * 0.5f };
+
+glm::mat4 benchViewProjection(float aspect)
+{
+	glm::mat4 projection{ glm::perspective(glm::radians(45.0f), aspect, 0.1f, 100.0f) };
+	glm::mat4 view{ glm::lookAt(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, -1.0f), glm::vec3(0.0f, 1.0f, 0.0f)) };
+	return projection * view;
+}
+
+BenchScene benchScene(size_t count, float aspect = 800.0f / 600.0f)
+{
+	BenchScene scene;
+	scene.viewProjection = benchViewProjection(aspect);
+	scene.frustum = extractFrustum(scene.viewProjection);
+	scene.positions = stressPositions(count, 50.0f);
+	scene.boxes.resize(count);
+	for (size_t i{ 0 }; i < count; i++)
+		scene.boxes[i] = Aabb::around(scene.positions[i], glm::vec3(benchCubeRadius));
+	return scene;
+}
+
+// The same cubes as the frustum kernel takes them
+BoundsBatch benchBounds(const BenchScene& scene)
+{
+	BoundsBatch bounds;
+	bounds.resize(scene.positions.size());
+	for (size_t i{ 0 }; i < scene.positions.size(); i++)
+		bounds.set(i, scene.positions[i], benchCubeRadius, glm::vec3(benchCubeRadius));
+	return bounds;
+}
+
+// Frustum test over every cube bound, the plain loop against the batch kernel
+void benchFrustumCulling()
+{
+	std::cout << "Frustum culling (batch kernel: " << frustumKernelName() << ")\n";
+
+	for (size_t count : { size_t{ 1000 }, size_t{ 100000 }, size_t{ 1000000 } })
+	{
+		BenchScene scene{ benchScene(count) };
+		BoundsBatch bounds{ benchBounds(scene) };
+		std::vector<std::uint32_t> visible(count);
+
+		int frames{ static_cast<int>(10000000 / count) + 1 };
+		size_t scalarVisible{ 0 };
+		size_t batchVisible{ 0 };
+
+		double scalarTime{ timeNanoseconds(frames, [&](int) {
+			scalarVisible = cullBoundsScalar(scene.frustum, bounds, 0, count, visible.data());
+		}) };
+
+		double batchTime{ timeNanoseconds(frames, [&](int) {
+			batchVisible = cullBounds(scene.frustum, bounds, visible.data());
+		}) };
+
+		std::cout << "  " << count << " bounds, " << batchVisible << " visible: scalar " << scalarTime / 1e6 << " ms, batch " << batchTime / 1e6 << " ms (";
+		std::cout << scalarTime / batchTime << "x)";
+		if (scalarVisible != batchVisible)
+			std::cout << ", MISMATCH scalar found " << scalarVisible;
+		std::cout << '\n';
+	}
+}
+
+// BVH build, refit and the three queries against looping over every box
+void benchBvh()
+{
+	const glm::vec3 rayOrigin(0.0f);
+	const glm::vec3 rayDirection{ glm::normalize(glm::vec3(0.1f, 0.05f, -1.0f)) };
+	const glm::vec3 lightPosition(2.0f, 1.0f, -5.0f);
+	const float lightRange{ 7.0f };
+
+	std::cout << "BVH against brute force\n";
+
+	for (size_t count : { size_t{ 1000 }, size_t{ 100000 }, size_t{ 1000000 } })
+	{
+		BenchScene scene{ benchScene(count) };
+		const Frustum& frustum{ scene.frustum };
+		const std::vector<Aabb>& boxes{ scene.boxes };
+
+		int builds{ static_cast<int>(1000000 / count) + 1 };
+		int queries{ static_cast<int>(10000000 / count) + 1 };
+		Bvh bvh;
+		double buildTime{ timeNanoseconds(builds, [&](int) { bvh.build(boxes); }) };
+		double refitTime{ timeNanoseconds(builds, [&](int) { bvh.refit(boxes); }) };
+
+		std::vector<std::uint32_t> found;
+		size_t bruteVisible{ 0 };
+		size_t bvhVisible{ 0 };
+		double bruteFrustum{ timeNanoseconds(queries, [&](int) {
+			found.clear();
+			for (size_t i{ 0 }; i < count; i++)
+				if (frustumOverlap(frustum, boxes[i], allFrustumPlanes) >= 0)
+					found.push_back(static_cast<std::uint32_t>(i));
+			bruteVisible = found.size();
+		}) };
+		double bvhFrustum{ timeNanoseconds(queries, [&](int) {
+			found.clear();
+			bvh.queryFrustum(frustum, boxes, found);
+			bvhVisible = found.size();
+		}) };
+
+		RayHit bruteHit;
+		RayHit bvhHit;
+		glm::vec3 inverse{ 1.0f / rayDirection };
+		double bruteRay{ timeNanoseconds(queries, [&](int) {
+			bruteHit = {};
+			for (size_t i{ 0 }; i < count; i++)
+			{
+				float distance{ rayBoxDistance(boxes[i], rayOrigin, inverse, bruteHit.distance) };
+				if (distance < bruteHit.distance)
+					bruteHit = { static_cast<std::uint32_t>(i), distance };
+			}
+		}) };
+		double bvhRay{ timeNanoseconds(queries, [&](int) { bvhHit = bvh.raycast(rayOrigin, rayDirection, boxes); }) };
+
+		size_t bruteLit{ 0 };
+		size_t bvhLit{ 0 };
+		double bruteSphere{ timeNanoseconds(queries, [&](int) {
+			found.clear();
+			for (size_t i{ 0 }; i < count; i++)
+				if (sphereOverlapsBox(lightPosition, lightRange, boxes[i]))
+					found.push_back(static_cast<std::uint32_t>(i));
+			bruteLit = found.size();
+		}) };
+		double bvhSphere{ timeNanoseconds(queries, [&](int) {
+			found.clear();
+			bvh.querySphere(lightPosition, lightRange, boxes, found);
+			bvhLit = found.size();
+		}) };
+
+		std::cout << "  " << count << " boxes, " << bvh.nodeCount() << " nodes: build " << buildTime / 1e6 << " ms, refit " << refitTime / 1e6 << " ms\n";
+		std::cout << "    frustum (" << bvhVisible << "): brute " << bruteFrustum / 1e3 << " us, BVH " << bvhFrustum / 1e3 << " us\n";
+		std::cout << "    ray (" << (bvhHit.hit() ? bvhHit.distance : -1.0f) << "): brute " << bruteRay / 1e3 << " us, BVH " << bvhRay / 1e3 << " us\n";
+		std::cout << "    sphere (" << bvhLit << "): brute " << bruteSphere / 1e3 << " us, BVH " << bvhSphere / 1e3 << " us\n";
+		if (bruteVisible != bvhVisible || bruteHit.distance != bvhHit.distance || bruteLit != bvhLit)
+			std::cout << "    MISMATCH brute force found " << bruteVisible << ", " << bruteHit.distance << ", " << bruteLit << '\n';
+	}
+}
+
+// Everything moves every frame: keeping the grid, refitting or rebuilding the BVH, and the queries on each
+void benchSpatialGrid()
+{
+	const glm::vec3 rayDirection{ glm::normalize(glm::vec3(0.1f, 0.05f, -1.0f)) };
+	const glm::vec3 lightPosition(2.0f, 1.0f, -5.0f);
+	const float lightRange{ 7.0f };
+	const int frames{ 20 };
+
+	std::cout << "Moving objects, " << frames << " frames\n";
+
+	for (size_t count : { size_t{ 10000 }, size_t{ 100000 } })
+	{
+		BenchScene scene{ benchScene(count) };
+		const Frustum& frustum{ scene.frustum };
+		std::vector<Aabb>& boxes{ scene.boxes };
+		// every object goes its own way, up to 0.5 a frame
+		std::vector<glm::vec3> velocities{ stressPositions(count, 0.5f) };
+		auto move = [&](int frame) {
+			for (size_t i{ 0 }; i < count; i++)
+				boxes[i] = Aabb::around(scene.positions[i] + velocities[i] * static_cast<float>(frame), glm::vec3(benchCubeRadius));
+		};
+
+		SpatialGrid grid;
+		Bvh refitted;
+		Bvh rebuilt;
+		grid.build(boxes);
+		refitted.build(boxes);
+
+		// the moving part is the same for all three, time it on its own and take it out
+		double moveTime{ timeNanoseconds(frames, [&](int frame) { move(frame + 1); }) };
+		double gridTime{ timeNanoseconds(frames, [&](int frame) {
+			move(frame + 1);
+			for (size_t i{ 0 }; i < count; i++)
+				grid.update(static_cast<std::uint32_t>(i), boxes[i]);
+		}) - moveTime };
+		double refitTime{ timeNanoseconds(frames, [&](int frame) {
+			move(frame + 1);
+			refitted.refit(boxes);
+		}) - moveTime };
+		double rebuildTime{ timeNanoseconds(frames, [&](int frame) {
+			move(frame + 1);
+			rebuilt.build(boxes);
+		}) - moveTime };
+
+		std::cout << "  " << count << " objects, update per frame: grid " << gridTime / 1e6 << " ms (" << grid.cellChanges() << " cell changes), BVH refit ";
+		std::cout << refitTime / 1e6 << " ms, BVH rebuild " << rebuildTime / 1e6 << " ms\n";
+
+		// after the last frame, the refitted tree has loosened up by now
+		std::vector<std::uint32_t> found;
+		auto frustumQuery = [&](const auto& index) {
+			return timeNanoseconds(100, [&](int) {
+				found.clear();
+				index.queryFrustum(frustum, boxes, found);
+			});
+		};
+		auto sphereQuery = [&](const auto& index) {
+			return timeNanoseconds(100, [&](int) {
+				found.clear();
+				index.querySphere(lightPosition, lightRange, boxes, found);
+			});
+		};
+		auto rayQuery = [&](const auto& index) {
+			volatile float sink{ 0.0f };
+			return timeNanoseconds(100, [&](int) { sink = index.raycast(glm::vec3(0.0f), rayDirection, boxes).distance; });
+		};
+
+		double gridFrustum{ frustumQuery(grid) };
+		size_t gridVisible{ found.size() };
+		double refitFrustum{ frustumQuery(refitted) };
+		double rebuiltFrustum{ frustumQuery(rebuilt) };
+		size_t bvhVisible{ found.size() };
+		double gridSphere{ sphereQuery(grid) };
+		size_t gridLit{ found.size() };
+		double refitSphere{ sphereQuery(refitted) };
+		double rebuiltSphere{ sphereQuery(rebuilt) };
+		size_t bvhLit{ found.size() };
+		double gridRay{ rayQuery(grid) };
+		double refitRay{ rayQuery(refitted) };
+		double rebuiltRay{ rayQuery(rebuilt) };
+
+		std::cout << "    frustum (" << gridVisible << "): grid " << gridFrustum / 1e3 << " us, refitted " << refitFrustum / 1e3 << " us, rebuilt " << rebuiltFrustum / 1e3 << " us\n";
+		std::cout << "    sphere (" << gridLit << "): grid " << gridSphere / 1e3 << " us, refitted " << refitSphere / 1e3 << " us, rebuilt " << rebuiltSphere / 1e3 << " us\n";
+		std::cout << "    ray: grid " << gridRay / 1e3 << " us, refitted " << refitRay / 1e3 << " us, rebuilt " << rebuiltRay / 1e3 << " us\n";
+
+		RayHit gridHit{ grid.raycast(glm::vec3(0.0f), rayDirection, boxes) };
+		RayHit bvhHit{ rebuilt.raycast(glm::vec3(0.0f), rayDirection, boxes) };
+		if (gridVisible != bvhVisible || gridLit != bvhLit || gridHit.distance != bvhHit.distance)
+			std::cout << "    MISMATCH the BVH found " << bvhVisible << ", " << bvhLit << ", " << bvhHit.distance << '\n';
+	}
+}
+
+// CPU occlusion buffer: a wall of boxes in front of the camera and lots of boxes around it, none of it needs GL
+// False when the SIMD depth buffer doesn't match the scalar one or an occluder closes a gap it doesn't cover
+bool benchOcclusion()
+{
+	// the occlusion buffer has the window's aspect
+	const float aspect{ 1200.0f / 800.0f };
+	glm::mat4 viewProjection{ benchViewProjection(aspect) };
+
+	// 4 x 4 slabs, 1.5 units apart and 1.6 wide so they overlap a little, about half the screen
+	std::vector<glm::mat4> wall;
+	for (int y{ 0 }; y < 4; y++)
+	{
+		for (int x{ 0 }; x < 4; x++)
+		{
+			glm::mat4 model{ glm::translate(glm::mat4(1.0f), glm::vec3((x - 1.5f) * 1.5f, (y - 1.5f) * 1.5f, -8.0f)) };
+			wall.push_back(glm::scale(model, glm::vec3(1.6f, 1.6f, 0.5f)));
+		}
+	}
+
+	ThreadPool pool;
+	OcclusionBuffer buffer;
+	auto draw = [&](ThreadPool* threads, bool simd) {
+		buffer.begin(viewProjection);
+		for (const glm::mat4& model : wall)
+			buffer.addBox(model);
+		buffer.rasterize(threads, simd);
+	};
+
+	std::cout << "Occlusion buffer " << buffer.width() << "x" << buffer.height() << " (kernel: " << occlusionKernelName() << ", " << pool.size() << " workers)\n";
+
+	double scalarTime{ timeNanoseconds(200, [&](int) { draw(nullptr, false); }) };
+	std::vector<float> scalarDepth{ buffer.depthBuffer() };
+	double simdTime{ timeNanoseconds(200, [&](int) { draw(nullptr, true); }) };
+	// not bit exact, the compiler may fuse the scalar loop's multiply adds
+	size_t differing{ 0 };
+	for (size_t i{ 0 }; i < scalarDepth.size(); i++)
+		differing += std::abs(scalarDepth[i] - buffer.depthBuffer()[i]) > 1e-4f * scalarDepth[i];
+	double threadedTime{ timeNanoseconds(200, [&](int) { draw(&pool, true); }) };
+	std::cout << "  rasterize " << buffer.stats.triangles << " triangles: scalar " << scalarTime / 1e3 << " us, SIMD " << simdTime / 1e3;
+	std::cout << " us, SIMD + workers " << threadedTime / 1e3 << " us";
+	if (differing > 0)
+		std::cout << ", WRONG " << differing << " pixels differ between scalar and SIMD";
+	std::cout << '\n';
+	bool passed{ differing == 0 };
+
+	for (size_t count : { size_t{ 10000 }, size_t{ 100000 } })
+	{
+		BenchScene scene{ benchScene(count, aspect) };
+
+		// only what the frustum keeps gets this far in the render loop
+		std::vector<std::uint32_t> inFrustum(count);
+		inFrustum.resize(cullBounds(scene.frustum, benchBounds(scene), inFrustum.data()));
+
+		size_t hidden{ 0 };
+		double testTime{ timeNanoseconds(20, [&](int) {
+			hidden = 0;
+			for (std::uint32_t i : inFrustum)
+				hidden += !buffer.visible(scene.boxes[i]);
+		}) };
+		std::cout << "  " << count << " boxes, " << inFrustum.size() << " in the frustum: " << hidden << " hidden, tests take " << testTime / 1e3 << " us\n";
+	}
+
+	// two slabs 0.8 buffer pixels apart, the gap runs between two pixel centers so an occluder that
+	// covers every pixel whose center it covers closes it. The box far behind shows through it
+	float pixel{ 2.0f * 5.0f * std::tan(glm::radians(22.5f)) * 1.5f / buffer.width() };
+	float gap{ 0.8f * pixel };
+	buffer.begin(viewProjection);
+	for (float side : { -1.0f, 1.0f })
+	{
+		glm::mat4 model{ glm::translate(glm::mat4(1.0f), glm::vec3(side * (gap * 0.5f + 1.0f), 0.0f, -5.0f)) };
+		buffer.addBox(glm::scale(model, glm::vec3(2.0f, 2.0f, 0.5f)));
+	}
+	buffer.rasterize();
+	if (!buffer.visible(Aabb::around(glm::vec3(0.0f, 0.0f, -20.0f), glm::vec3(0.25f))))
+	{
+		std::cout << "  WRONG a box behind a gap of 0.8 pixels between two occluders counts as hidden\n";
+		passed = false;
+	}
+	return passed;
+}
+
+// Non indexed UV sphere with position, normal and texture coordinates, like the cube in Source.cpp
+std::vector<float> sphereTriangleList(int rings, int segments)
+{
+	auto vertex = [&](std::vector<float>& out, int ring, int segment) {
+		float u{ static_cast<float>(segment) / segments };
+		float v{ static_cast<float>(ring) / rings };
+		float theta{ u * 2.0f * 3.14159265f };
+		float phi{ v * 3.14159265f };
+		glm::vec3 p(std::cos(theta) * std::sin(phi), std::cos(phi), std::sin(theta) * std::sin(phi));
+		out.insert(out.end(), { p.x * 0.5f, p.y * 0.5f, p.z * 0.5f, p.x, p.y, p.z, u, v });
+	};
+
+	std::vector<float> vertices;
+	for (int ring{ 0 }; ring < rings; ring++)
+	{
+		for (int segment{ 0 }; segment < segments; segment++)
+		{
+			vertex(vertices, ring, segment);
+			vertex(vertices, ring + 1, segment);
+			vertex(vertices, ring + 1, segment + 1);
+			vertex(vertices, ring, segment);
+			vertex(vertices, ring + 1, segment + 1);
+			vertex(vertices, ring, segment + 1);
+		}
+	}
+	return vertices;
+}
+
+// Vertex cache efficiency of the mesh build step, before (welded, original order) and after
+void benchMeshOptimization(const float* cubeVertices, size_t cubeVertexCount)
+{
+	std::vector<float> sphere{ sphereTriangleList(64, 128) };
+
+	struct Input
+	{
+		const char* name;
+		const float* vertices;
+		size_t vertexCount;
+	};
+	const Input inputs[] = {
+		{ "cube", cubeVertices, cubeVertexCount },
+		{ "sphere", sphere.data(), sphere.size() / 8 },
+	};
+
+	std::cout << "Mesh build (FIFO cache of " << vertexCacheSize << ")\n";
+	for (const Input& input : inputs)
+	{
+		Mesh welded{ weldVertices(input.vertices, input.vertexCount, 8) };
+		CacheStats before{ simulateVertexCache(welded.indices, welded.vertexCount()) };
+
+		Mesh mesh;
+		double buildTime{ timeNanoseconds(1, [&](int) { mesh = buildMesh(input.vertices, input.vertexCount, 8); }) };
+		CacheStats after{ simulateVertexCache(mesh.indices, mesh.vertexCount()) };
+
+		std::cout << "  " << input.name << ": " << input.vertexCount << " -> " << mesh.vertexCount() << " vertices, ";
+		std::cout << "ACMR " << before.acmr << " -> " << after.acmr << ", ATVR " << before.atvr << " -> " << after.atvr;
+		std::cout << " (" << buildTime / 1e6 << " ms)\n";
+	}
+}
+
+// Whole texture loads, png decode + glGenerateMipmap against mapping a .htex and uploading its levels
+// Cold runs drop the file from the page cache first (where the OS allows it, and only count as cold
+// when none of it is left there), warm ones are averaged
+void benchTextureLoad(const std::string& png, int iterations = 10)
+{
+	stbi_set_flip_vertically_on_load(true);
+	int width, height, channels;
+	unsigned char* pixels{ stbi_load(png.c_str(), &width, &height, &channels, 4) };
+	if (!pixels)
+		return;
+	std::vector<TextureLevel> chain{ generateMipChain({ width, height, std::vector<std::uint8_t>(pixels, pixels + static_cast<size_t>(width) * height * 4) }, MipFilter::Box, TextureColorSpace::SRGB) };
+	stbi_image_free(pixels);
+
+	struct Method
+	{
+		std::string name;
+		std::string path;
+		TextureFormat format;
+	};
+	std::vector<Method> methods{ { "png + glGenerateMipmap", png, TextureFormat::RGBA8 } };
+	const std::pair<TextureFormat, const char*> formats[]{ { TextureFormat::RGBA8, "htex rgba8" }, { TextureFormat::BC1, "htex bc1" }, { TextureFormat::BC7, "htex bc7" } };
+	for (const auto& [format, name] : formats)
+	{
+		if (!textureFormatSupported(format))
+			continue;
+		// written next to the png and removed again at the end
+		std::string path{ png + ".bench" + std::to_string(static_cast<int>(format)) + ".htex" };
+		if (writeTextureFile(path, format, compressMipChain(chain, format)))
+			methods.push_back({ name, path, format });
+	}
+
+	auto load = [](const Method& method) {
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glState.bindTextureForEditing(GL_TEXTURE_2D, texture);
+		if (method.format == TextureFormat::RGBA8 && !isTextureFilePath(method.path))
+		{
+			int w, h, c;
+			unsigned char* data{ stbi_load(method.path.c_str(), &w, &h, &c, 4) };
+			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+			glGenerateMipmap(GL_TEXTURE_2D);
+			stbi_image_free(data);
+		}
+		else
+		{
+			TextureFile file;
+			if (openTextureFile(method.path, file))
+				uploadTextureLevels(file.header.format, file.levels, file.mapping.data());
+		}
+		// the upload isn't done until the driver has the texels
+		glFinish();
+		glDeleteTextures(1, &texture);
+		glState.forgetTexture(texture);
+	};
+
+	std::cout << "Texture load (" << png << ", " << width << "x" << height << ", " << chain.size() << " levels)\n";
+	for (const Method& method : methods)
+	{
+		double stillCached{ evictFromPageCache(method.path) };
+		double cold{ timeNanoseconds(1, [&](int) { load(method); }) };
+		double warm{ timeNanoseconds(iterations, [&](int) { load(method); }) };
+
+		MappedFile file{ method.path };
+		std::cout << "  " << method.name << ": " << file.size() / 1024 << " KB, ";
+		if (stillCached == 0.0)
+			std::cout << "cold ";
+		else if (stillCached > 0.0)
+			std::cout << "first (" << static_cast<int>(stillCached * 100.0) << "% still cached) ";
+		else
+			std::cout << "first ";
+		std::cout << cold / 1e6 << " ms, warm " << warm / 1e6 << " ms\n";
+	}
+
+	for (const Method& method : methods)
+		if (isTextureFilePath(method.path))
+			std::remove(method.path.c_str());
+}
+
+// CPU mip chains for every filter, SIMD and scalar, against glGenerateMipmap on the same image
+void benchMipGeneration(const std::string& png, int iterations = 10)
+{
+	stbi_set_flip_vertically_on_load(true);
+	int width, height, channels;
+	unsigned char* pixels{ stbi_load(png.c_str(), &width, &height, &channels, 4) };
+	if (!pixels)
+		return;
+	TextureLevel base{ width, height, std::vector<std::uint8_t>(pixels, pixels + static_cast<size_t>(width) * height * 4) };
+	stbi_image_free(pixels);
+
+	std::cout << "Mip generation (" << png << ", " << width << "x" << height << ", kernel: " << mipKernelName() << ")\n";
+
+	GLuint texture;
+	glGenTextures(1, &texture);
+	glState.bindTextureForEditing(GL_TEXTURE_2D, texture);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, base.data.data());
+	glFinish();
+	double driver{ timeNanoseconds(iterations, [&](int) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		glFinish();
+	}) };
+	glDeleteTextures(1, &texture);
+	glState.forgetTexture(texture);
+	std::cout << "  glGenerateMipmap: " << driver / 1e6 << " ms\n";
+
+	const std::pair<MipFilter, const char*> filters[]{ { MipFilter::Box, "box" }, { MipFilter::Kaiser, "kaiser" }, { MipFilter::Lanczos, "lanczos" } };
+	for (const auto& [filter, name] : filters)
+	{
+		double simd{ timeNanoseconds(iterations, [&](int) { generateMipChain(base, filter, TextureColorSpace::SRGB); }) };
+		double scalar{ timeNanoseconds(iterations, [&](int) { generateMipChain(base, filter, TextureColorSpace::SRGB, false); }) };
+		double linear{ timeNanoseconds(iterations, [&](int) { generateMipChain(base, filter, TextureColorSpace::Linear); }) };
+		std::cout << "  " << name << ": sRGB " << simd / 1e6 << " ms (scalar " << scalar / 1e6 << " ms, " << scalar / simd << "x), ";
+		std::cout << "linear " << linear / 1e6 << " ms\n";
+	}
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include "frustum.h"
+
+// Axis aligned boxes and the tests every spatial index shares
+// The BVH and the grid answer the same three questions with these: what's in the frustum,
+// what's the first thing along a ray, and what's within a radius of a point
+
+struct Aabb
+{
+	// empty until something is grown into it
+	glm::vec3 min{ std::numeric_limits<float>::max() };
+	glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+	static Aabb around(glm::vec3 center, glm::vec3 extents) { return { center - extents, center + extents }; }
+
+	void grow(glm::vec3 point)
+	{
+		min = glm::min(min, point);
+		max = glm::max(max, point);
+	}
+
+	void grow(const Aabb& other)
+	{
+		min = glm::min(min, other.min);
+		max = glm::max(max, other.max);
+	}
+
+	glm::vec3 center() const { return (min + max) * 0.5f; }
+	glm::vec3 extents() const { return (max - min) * 0.5f; }
+
+	// 0 for an empty box
+	float surfaceArea() const
+	{
+		glm::vec3 size{ glm::max(max - min, glm::vec3(0.0f)) };
+		return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+	}
+};
+
+// Nearest object along a ray
+struct RayHit
+{
+	static constexpr std::uint32_t none{ std::numeric_limits<std::uint32_t>::max() };
+
+	std::uint32_t index{ none };
+	float distance{ std::numeric_limits<float>::max() };
+
+	bool hit() const { return index != none; }
+};
+
+// Bit i set means plane i of the frustum still has to be tested
+constexpr int allFrustumPlanes{ 0x3F };
+
+// Tests box against the planes in mask. -1 when it's outside one of them, otherwise the planes it straddles,
+// so children of a box that's fully inside a plane can skip that plane, and 0 means entirely inside
+inline int frustumOverlap(const Frustum& frustum, const Aabb& box, int mask)
+{
+	glm::vec3 center{ box.center() };
+	glm::vec3 extents{ box.extents() };
+	int straddling{ 0 };
+	for (int i{ 0 }; i < 6; i++)
+	{
+		if (!(mask & (1 << i)))
+			continue;
+		const glm::vec4& plane{ frustum.planes[i] };
+		float distance{ glm::dot(glm::vec3(plane), center) + plane.w };
+		float radius{ glm::dot(glm::abs(glm::vec3(plane)), extents) };
+		if (distance < -radius)
+			return -1;
+		if (distance < radius)
+			straddling |= 1 << i;
+	}
+	return straddling;
+}
+
+// Box around the frustum's eight corners, each one where a side, a top or bottom and the near or far plane meet
+inline Aabb frustumBounds(const Frustum& frustum)
+{
+	Aabb box;
+	for (int x{ 0 }; x < 2; x++)
+	{
+		for (int y{ 2 }; y < 4; y++)
+		{
+			for (int z{ 4 }; z < 6; z++)
+			{
+				const glm::vec4& a{ frustum.planes[x] };
+				const glm::vec4& b{ frustum.planes[y] };
+				const glm::vec4& c{ frustum.planes[z] };
+				glm::vec3 bc{ glm::cross(glm::vec3(b), glm::vec3(c)) };
+				glm::vec3 ca{ glm::cross(glm::vec3(c), glm::vec3(a)) };
+				glm::vec3 ab{ glm::cross(glm::vec3(a), glm::vec3(b)) };
+				box.grow(-(a.w * bc + b.w * ca + c.w * ab) / glm::dot(glm::vec3(a), bc));
+			}
+		}
+	}
+	return box;
+}
+
+// Slab test, inverseDirection is 1 / direction per axis (infinities are fine)
+// Returns the distance the ray enters the box at, 0 when it starts inside, or the float max when it misses
+// or the box is further than maxDistance
+inline float rayBoxDistance(const Aabb& box, glm::vec3 origin, glm::vec3 inverseDirection, float maxDistance)
+{
+	glm::vec3 t0{ (box.min - origin) * inverseDirection };
+	glm::vec3 t1{ (box.max - origin) * inverseDirection };
+	glm::vec3 closer{ glm::min(t0, t1) };
+	glm::vec3 further{ glm::max(t0, t1) };
+	float enter{ std::max(std::max(closer.x, closer.y), std::max(closer.z, 0.0f)) };
+	float exit{ std::min(std::min(further.x, further.y), std::min(further.z, maxDistance)) };
+	return enter <= exit ? enter : std::numeric_limits<float>::max();
+}
+
+inline bool sphereOverlapsBox(glm::vec3 center, float radius, const Aabb& box)
+{
+	glm::vec3 closest{ glm::clamp(center, box.min, box.max) };
+	glm::vec3 offset{ closest - center };
+	return glm::dot(offset, offset) <= radius * radius;
+}
@@ -0,0 +1,364 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "bounds.h"
+#include "frustum.h"
+
+// Bounding volume hierarchy over objects that (mostly) stay where they are
+// Built top down with the surface area heuristic over binned centroids, stored as one flat
+// array of 32 byte nodes where the two children of a node sit next to each other.
+// Objects that move a little can refit() the boxes in place, the tree itself stays the same,
+// so it gets looser the further things wander. Rebuild when that happens, or use a grid
+// Objects are referred to by their index in the bounds the tree was built from
+
+struct BvhNode
+{
+	glm::vec3 min;
+	// leaves: the first object in Bvh::objects, interior nodes: the left child, the right one follows it
+	std::uint32_t first;
+	glm::vec3 max;
+	// 0 for interior nodes
+	std::uint32_t count;
+
+	bool leaf() const { return count > 0; }
+	Aabb bounds() const { return { min, max }; }
+};
+static_assert(sizeof(BvhNode) == 32, "two nodes to a cache line");
+
+class Bvh
+{
+public:
+	// objects per leaf the builder stops at, and the most it leaves in one when splitting doesn't pay
+	static constexpr std::uint32_t minLeafSize{ 2 };
+	static constexpr std::uint32_t maxLeafSize{ 16 };
+	static constexpr int binCount{ 16 };
+	// keeps the fixed size traversal stacks below from overflowing
+	static constexpr int maxDepth{ 48 };
+
+	void build(const std::vector<Aabb>& bounds)
+	{
+		nodes.clear();
+		objects.clear();
+		if (bounds.empty())
+			return;
+
+		// the builder shuffles copies of the boxes instead of indices into bounds, so every pass over a node reads memory in order
+		items.resize(bounds.size());
+		for (size_t i{ 0 }; i < bounds.size(); i++)
+			items[i] = { bounds[i], bounds[i].center(), static_cast<std::uint32_t>(i) };
+
+		// at most 2n - 1 nodes, reserve so they don't move while building
+		nodes.reserve(bounds.size() * 2);
+		nodes.push_back({ glm::vec3(0.0f), 0, glm::vec3(0.0f), static_cast<std::uint32_t>(bounds.size()) });
+
+		// node and its depth
+		std::vector<std::pair<std::uint32_t, int>> stack{ { 0, 0 } };
+		while (!stack.empty())
+		{
+			auto [index, depth] = stack.back();
+			stack.pop_back();
+			if (split(index, depth < maxDepth))
+			{
+				stack.push_back({ nodes[index].first + 1, depth + 1 });
+				stack.push_back({ nodes[index].first, depth + 1 });
+			}
+		}
+
+		objects.resize(items.size());
+		for (size_t i{ 0 }; i < items.size(); i++)
+			objects[i] = items[i].object;
+		items.clear();
+		items.shrink_to_fit();
+	}
+
+	// Recomputes every box bottom up after objects moved, same objects as the build
+	// Children always come after their parent in the array, so one backwards pass does it
+	void refit(const std::vector<Aabb>& bounds)
+	{
+		for (size_t i{ nodes.size() }; i-- > 0;)
+		{
+			BvhNode& node{ nodes[i] };
+			Aabb box;
+			if (node.leaf())
+			{
+				for (std::uint32_t j{ 0 }; j < node.count; j++)
+					box.grow(bounds[objects[node.first + j]]);
+			}
+			else
+			{
+				box.grow(nodes[node.first].bounds());
+				box.grow(nodes[node.first + 1].bounds());
+			}
+			node.min = box.min;
+			node.max = box.max;
+		}
+	}
+
+	// Appends every object whose box intersects the frustum to out
+	// A subtree that is entirely inside goes in without testing anything below it
+	void queryFrustum(const Frustum& frustum, const std::vector<Aabb>& bounds, std::vector<std::uint32_t>& out) const
+	{
+		if (nodes.empty())
+			return;
+
+		// node and the planes it still straddles
+		std::pair<std::uint32_t, int> stack[64];
+		int top{ 0 };
+		stack[top++] = { 0, allFrustumPlanes };
+		while (top > 0)
+		{
+			auto [index, planes] = stack[--top];
+			const BvhNode& node{ nodes[index] };
+			int overlap{ frustumOverlap(frustum, node.bounds(), planes) };
+			if (overlap < 0)
+				continue;
+			if (overlap == 0)
+			{
+				appendSubtree(index, out);
+				continue;
+			}
+			if (node.leaf())
+			{
+				for (std::uint32_t j{ 0 }; j < node.count; j++)
+				{
+					std::uint32_t object{ objects[node.first + j] };
+					if (frustumOverlap(frustum, bounds[object], overlap) >= 0)
+						out.push_back(object);
+				}
+				continue;
+			}
+			stack[top++] = { node.first + 1, overlap };
+			stack[top++] = { node.first, overlap };
+		}
+	}
+
+	// Nearest object box the ray hits, direction doesn't have to be normalized but distances are in its units
+	// For picking, with the camera's Position and Front
+	RayHit raycast(glm::vec3 origin, glm::vec3 direction, const std::vector<Aabb>& bounds, float maxDistance = std::numeric_limits<float>::max()) const
+	{
+		RayHit best;
+		best.distance = maxDistance;
+		if (nodes.empty())
+			return best;
+
+		glm::vec3 inverse{ 1.0f / direction };
+		constexpr float miss{ std::numeric_limits<float>::max() };
+
+		// node and the distance the ray enters its box at
+		std::pair<std::uint32_t, float> stack[64];
+		int top{ 0 };
+		float rootDistance{ rayBoxDistance(nodes[0].bounds(), origin, inverse, best.distance) };
+		if (rootDistance != miss)
+			stack[top++] = { 0, rootDistance };
+
+		while (top > 0)
+		{
+			auto [index, entry] = stack[--top];
+			// something closer turned up since this was pushed
+			if (entry > best.distance)
+				continue;
+
+			const BvhNode& node{ nodes[index] };
+			if (node.leaf())
+			{
+				for (std::uint32_t j{ 0 }; j < node.count; j++)
+				{
+					std::uint32_t object{ objects[node.first + j] };
+					float distance{ rayBoxDistance(bounds[object], origin, inverse, best.distance) };
+					if (distance != miss && distance < best.distance)
+						best = { object, distance };
+				}
+				continue;
+			}
+
+			// the nearer child goes on top so it's visited first and shrinks best.distance for the other one
+			std::uint32_t left{ node.first };
+			std::uint32_t right{ node.first + 1 };
+			float leftDistance{ rayBoxDistance(nodes[left].bounds(), origin, inverse, best.distance) };
+			float rightDistance{ rayBoxDistance(nodes[right].bounds(), origin, inverse, best.distance) };
+			if (leftDistance > rightDistance)
+			{
+				std::swap(left, right);
+				std::swap(leftDistance, rightDistance);
+			}
+			if (rightDistance != miss)
+				stack[top++] = { right, rightDistance };
+			if (leftDistance != miss)
+				stack[top++] = { left, leftDistance };
+		}
+		return best;
+	}
+
+	// Appends every object whose box is within radius of center, which objects a point light reaches
+	void querySphere(glm::vec3 center, float radius, const std::vector<Aabb>& bounds, std::vector<std::uint32_t>& out) const
+	{
+		if (nodes.empty())
+			return;
+
+		std::uint32_t stack[64];
+		int top{ 0 };
+		stack[top++] = 0;
+		while (top > 0)
+		{
+			const BvhNode& node{ nodes[stack[--top]] };
+			if (!sphereOverlapsBox(center, radius, node.bounds()))
+				continue;
+			if (node.leaf())
+			{
+				for (std::uint32_t j{ 0 }; j < node.count; j++)
+				{
+					std::uint32_t object{ objects[node.first + j] };
+					if (sphereOverlapsBox(center, radius, bounds[object]))
+						out.push_back(object);
+				}
+				continue;
+			}
+			stack[top++] = node.first + 1;
+			stack[top++] = node.first;
+		}
+	}
+
+	size_t nodeCount() const { return nodes.size(); }
+
+private:
+	std::vector<BvhNode> nodes;
+	// object indices, every leaf owns a contiguous run of them
+	std::vector<std::uint32_t> objects;
+	// only while building
+	struct BuildItem
+	{
+		Aabb box;
+		glm::vec3 centroid;
+		std::uint32_t object;
+	};
+	std::vector<BuildItem> items;
+
+	// Sets the node's box and splits it in two when that's cheaper than a leaf, true when it did
+	bool split(std::uint32_t index, bool allowed)
+	{
+		std::uint32_t first{ nodes[index].first };
+		std::uint32_t count{ nodes[index].count };
+		BuildItem* begin{ items.data() + first };
+		BuildItem* end{ begin + count };
+
+		Aabb box;
+		Aabb centroidBox;
+		for (const BuildItem* item{ begin }; item != end; item++)
+		{
+			box.grow(item->box);
+			centroidBox.grow(item->centroid);
+		}
+		nodes[index].min = box.min;
+		nodes[index].max = box.max;
+
+		if (count <= minLeafSize || !allowed)
+			return false;
+
+		// bin the centroids along all three axes in one pass
+		struct Bin
+		{
+			Aabb box;
+			std::uint32_t count{ 0 };
+		};
+		Bin bins[3][binCount];
+		glm::vec3 centroidSize{ centroidBox.max - centroidBox.min };
+		// an axis every centroid shares a coordinate on ends up all in bin 0 and never wins
+		glm::vec3 scale{ glm::vec3(binCount) / glm::max(centroidSize, glm::vec3(1e-20f)) };
+		// all three axes at once, glm's vec3 [] is a switch and way too slow for this loop
+		auto binsOf = [&](const BuildItem& item) {
+			return glm::min(glm::ivec3((item.centroid - centroidBox.min) * scale), glm::ivec3(binCount - 1));
+		};
+		for (const BuildItem* item{ begin }; item != end; item++)
+		{
+			glm::ivec3 bin{ binsOf(*item) };
+			const int axisBins[3]{ bin.x, bin.y, bin.z };
+			for (int axis{ 0 }; axis < 3; axis++)
+			{
+				bins[axis][axisBins[axis]].box.grow(item->box);
+				bins[axis][axisBins[axis]].count++;
+			}
+		}
+
+		// best bin boundary over all three axes, cost is area * objects on each side
+		int bestAxis{ -1 };
+		int bestBoundary{ 0 };
+		float bestCost{ std::numeric_limits<float>::max() };
+		for (int axis{ 0 }; axis < 3; axis++)
+		{
+			// sweep from the right to get the right side of every boundary, then from the left
+			float rightArea[binCount - 1];
+			std::uint32_t rightCount[binCount - 1];
+			Aabb right;
+			std::uint32_t objectsRight{ 0 };
+			for (int boundary{ binCount - 1 }; boundary > 0; boundary--)
+			{
+				right.grow(bins[axis][boundary].box);
+				objectsRight += bins[axis][boundary].count;
+				rightArea[boundary - 1] = right.surfaceArea();
+				rightCount[boundary - 1] = objectsRight;
+			}
+
+			Aabb left;
+			std::uint32_t objectsLeft{ 0 };
+			for (int boundary{ 1 }; boundary < binCount; boundary++)
+			{
+				left.grow(bins[axis][boundary - 1].box);
+				objectsLeft += bins[axis][boundary - 1].count;
+				if (objectsLeft == 0 || rightCount[boundary - 1] == 0)
+					continue;
+				float cost{ left.surfaceArea() * objectsLeft + rightArea[boundary - 1] * rightCount[boundary - 1] };
+				if (cost < bestCost)
+				{
+					bestCost = cost;
+					bestAxis = axis;
+					bestBoundary = boundary;
+				}
+			}
+		}
+
+		// one traversal step costs about as much as testing one object
+		float leafCost{ box.surfaceArea() * count };
+		float splitCost{ box.surfaceArea() + bestCost };
+		if (bestAxis < 0 || (splitCost >= leafCost && count <= maxLeafSize))
+			return false;
+
+		BuildItem* middle{ std::partition(begin, end, [&](const BuildItem& item) {
+			glm::ivec3 bin{ binsOf(item) };
+			const int axisBins[3]{ bin.x, bin.y, bin.z };
+			return axisBins[bestAxis] < bestBoundary;
+		}) };
+		std::uint32_t leftCount{ static_cast<std::uint32_t>(middle - begin) };
+
+		std::uint32_t child{ static_cast<std::uint32_t>(nodes.size()) };
+		nodes.push_back({ glm::vec3(0.0f), first, glm::vec3(0.0f), leftCount });
+		nodes.push_back({ glm::vec3(0.0f), first + leftCount, glm::vec3(0.0f), count - leftCount });
+		nodes[index].first = child;
+		nodes[index].count = 0;
+		return true;
+	}
+
+	// Everything below index, no tests
+	void appendSubtree(std::uint32_t index, std::vector<std::uint32_t>& out) const
+	{
+		std::uint32_t stack[64];
+		int top{ 0 };
+		stack[top++] = index;
+		while (top > 0)
+		{
+			const BvhNode& node{ nodes[stack[--top]] };
+			if (node.leaf())
+			{
+				out.insert(out.end(), objects.begin() + node.first, objects.begin() + node.first + node.count);
+				continue;
+			}
+			stack[top++] = node.first + 1;
+			stack[top++] = node.first;
+		}
+	}
+};
@@ -0,0 +1,223 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// View frustum culling
+// The six planes come straight out of projection * view once per frame, every object has
+// a bounding sphere and an AABB and is kept when it's on the inside of all six planes.
+// Per plane the object gets the smaller of its two "radii" (sphere radius, or the box extents
+// projected onto the plane normal), so it's as tight as whichever volume fits better.
+// Conservative, an object near a frustum corner can survive while being off screen
+// The AVX kernel tests 8 objects at a time when compiled with /arch:AVX (-mavx) or better,
+// SSE2 does 4, and the scalar loop handles the leftover objects and anything without SSE2
+
+#if defined(__AVX__)
+#define FRUSTUM_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FRUSTUM_SSE2
+#include <emmintrin.h>
+#endif
+
+// Planes as (normal, distance), normals point inwards and are unit length
+// so dot(normal, p) + distance is the signed distance of p
+struct Frustum
+{
+	// left, right, bottom, top, near, far
+	glm::vec4 planes[6];
+};
+
+// Gribb/Hartmann, the planes are sums and differences of the rows of the clip matrix
+inline Frustum extractFrustum(const glm::mat4& viewProjection)
+{
+	// glm is column major, row i is m[0][i], m[1][i], m[2][i], m[3][i]
+	auto row = [&](int i) { return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]); };
+
+	Frustum frustum;
+	for (int axis{ 0 }; axis < 3; axis++)
+	{
+		frustum.planes[axis * 2] = row(3) + row(axis);
+		frustum.planes[axis * 2 + 1] = row(3) - row(axis);
+	}
+	for (glm::vec4& plane : frustum.planes)
+		plane /= glm::length(glm::vec3(plane));
+	return frustum;
+}
+
+// For the odd single object that isn't worth a batch
+inline bool sphereInFrustum(const Frustum& frustum, glm::vec3 center, float radius)
+{
+	for (const glm::vec4& plane : frustum.planes)
+	{
+		if (glm::dot(glm::vec3(plane), center) + plane.w < -radius)
+			return false;
+	}
+	return true;
+}
+
+// Bounding volumes in structure of arrays form so the kernels can load 4 or 8 of each at once
+// The sphere and the box share their center
+struct BoundsBatch
+{
+	std::vector<float> x, y, z;
+	std::vector<float> radius;
+	// half size of the AABB along each axis
+	std::vector<float> extentX, extentY, extentZ;
+
+	void resize(size_t count)
+	{
+		for (std::vector<float>* array : { &x, &y, &z, &radius, &extentX, &extentY, &extentZ })
+			array->resize(count);
+	}
+
+	size_t size() const { return x.size(); }
+
+	void set(size_t i, glm::vec3 center, float sphereRadius, glm::vec3 extents)
+	{
+		x[i] = center.x;
+		y[i] = center.y;
+		z[i] = center.z;
+		radius[i] = sphereRadius;
+		extentX[i] = extents.x;
+		extentY[i] = extents.y;
+		extentZ[i] = extents.z;
+	}
+};
+
+// Plain loop, also does the tail the SIMD kernels leave over
+// Appends the indices of the visible objects in [first, last) to visible, returns how many
+inline size_t cullBoundsScalar(const Frustum& frustum, const BoundsBatch& bounds, size_t first, size_t last, std::uint32_t* visible)
+{
+	size_t count{ 0 };
+	for (size_t i{ first }; i < last; i++)
+	{
+		bool inside{ true };
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			float distance{ plane.x * bounds.x[i] + plane.y * bounds.y[i] + plane.z * bounds.z[i] + plane.w };
+			float box{ std::abs(plane.x) * bounds.extentX[i] + std::abs(plane.y) * bounds.extentY[i] + std::abs(plane.z) * bounds.extentZ[i] };
+			inside = inside && distance >= -std::min(bounds.radius[i], box);
+		}
+		visible[count] = static_cast<std::uint32_t>(i);
+		count += inside;
+	}
+	return count;
+}
+
+#if defined(FRUSTUM_SSE2)
+
+inline size_t cullBoundsSSE(const Frustum& frustum, const BoundsBatch& bounds, size_t count, std::uint32_t* visible)
+{
+	const __m128 signMask{ _mm_set1_ps(-0.0f) };
+	size_t written{ 0 };
+
+	for (size_t i{ 0 }; i < count; i += 4)
+	{
+		__m128 x{ _mm_loadu_ps(&bounds.x[i]) };
+		__m128 y{ _mm_loadu_ps(&bounds.y[i]) };
+		__m128 z{ _mm_loadu_ps(&bounds.z[i]) };
+		__m128 radius{ _mm_loadu_ps(&bounds.radius[i]) };
+		__m128 ex{ _mm_loadu_ps(&bounds.extentX[i]) };
+		__m128 ey{ _mm_loadu_ps(&bounds.extentY[i]) };
+		__m128 ez{ _mm_loadu_ps(&bounds.extentZ[i]) };
+
+		__m128 inside{ _mm_castsi128_ps(_mm_set1_epi32(-1)) };
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			__m128 nx{ _mm_set1_ps(plane.x) };
+			__m128 ny{ _mm_set1_ps(plane.y) };
+			__m128 nz{ _mm_set1_ps(plane.z) };
+			__m128 distance{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, x), _mm_mul_ps(ny, y)), _mm_add_ps(_mm_mul_ps(nz, z), _mm_set1_ps(plane.w))) };
+			__m128 box{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, nx), ex), _mm_mul_ps(_mm_andnot_ps(signMask, ny), ey)), _mm_mul_ps(_mm_andnot_ps(signMask, nz), ez)) };
+			// distance + min(radius, box) >= 0
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, _mm_min_ps(radius, box)), _mm_setzero_ps()));
+		}
+
+		// write every index and only advance past the visible ones, no branches per object
+		int mask{ _mm_movemask_ps(inside) };
+		for (int lane{ 0 }; lane < 4; lane++)
+		{
+			visible[written] = static_cast<std::uint32_t>(i + lane);
+			written += (mask >> lane) & 1;
+		}
+	}
+	return written;
+}
+
+#endif
+
+#if defined(FRUSTUM_AVX)
+
+inline size_t cullBoundsAVX(const Frustum& frustum, const BoundsBatch& bounds, size_t count, std::uint32_t* visible)
+{
+	const __m256 signMask{ _mm256_set1_ps(-0.0f) };
+	size_t written{ 0 };
+
+	for (size_t i{ 0 }; i < count; i += 8)
+	{
+		__m256 x{ _mm256_loadu_ps(&bounds.x[i]) };
+		__m256 y{ _mm256_loadu_ps(&bounds.y[i]) };
+		__m256 z{ _mm256_loadu_ps(&bounds.z[i]) };
+		__m256 radius{ _mm256_loadu_ps(&bounds.radius[i]) };
+		__m256 ex{ _mm256_loadu_ps(&bounds.extentX[i]) };
+		__m256 ey{ _mm256_loadu_ps(&bounds.extentY[i]) };
+		__m256 ez{ _mm256_loadu_ps(&bounds.extentZ[i]) };
+
+		__m256 inside{ _mm256_castsi256_ps(_mm256_set1_epi32(-1)) };
+		for (const glm::vec4& plane : frustum.planes)
+		{
+			__m256 nx{ _mm256_set1_ps(plane.x) };
+			__m256 ny{ _mm256_set1_ps(plane.y) };
+			__m256 nz{ _mm256_set1_ps(plane.z) };
+			__m256 distance{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, x), _mm256_mul_ps(ny, y)), _mm256_add_ps(_mm256_mul_ps(nz, z), _mm256_set1_ps(plane.w))) };
+			__m256 box{ _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(_mm256_andnot_ps(signMask, nx), ex), _mm256_mul_ps(_mm256_andnot_ps(signMask, ny), ey)), _mm256_mul_ps(_mm256_andnot_ps(signMask, nz), ez)) };
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, _mm256_min_ps(radius, box)), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		int mask{ _mm256_movemask_ps(inside) };
+		for (int lane{ 0 }; lane < 8; lane++)
+		{
+			visible[written] = static_cast<std::uint32_t>(i + lane);
+			written += (mask >> lane) & 1;
+		}
+	}
+	return written;
+}
+
+#endif
+
+// Writes the indices of the objects that intersect the frustum to visible, in order, and returns how many
+// visible needs room for bounds.size() indices
+inline size_t cullBounds(const Frustum& frustum, const BoundsBatch& bounds, std::uint32_t* visible)
+{
+	size_t count{ bounds.size() };
+	size_t vectorized{ 0 };
+	size_t written{ 0 };
+
+#if defined(FRUSTUM_AVX)
+	vectorized = count - count % 8;
+	written = cullBoundsAVX(frustum, bounds, vectorized, visible);
+#elif defined(FRUSTUM_SSE2)
+	vectorized = count - count % 4;
+	written = cullBoundsSSE(frustum, bounds, vectorized, visible);
+#endif
+
+	return written + cullBoundsScalar(frustum, bounds, vectorized, count, visible + written);
+}
+
+// Which kernel cullBounds uses, for printing
+inline const char* frustumKernelName()
+{
+#if defined(FRUSTUM_AVX)
+	return "AVX";
+#elif defined(FRUSTUM_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,245 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+
+// Shadow copy of the GL state we touch, sits between the app and glad
+// Every bind, enable and viewport call goes through glState and is dropped when it
+// would set what's already current. Anything that changes state behind its back
+// (or a new context) has to call invalidate() so the next call is issued for real
+
+// Calls issued to the driver and dropped because nothing would change
+// The render loop resets it every frame
+struct GLStateStats
+{
+	unsigned int issued{ 0 };
+	unsigned int elided{ 0 };
+};
+
+class GLStateCache
+{
+public:
+	static constexpr int maxTextureUnits{ 16 };
+
+	GLStateStats stats;
+
+	GLStateCache()
+	{
+		invalidate();
+	}
+
+	// Forget everything, the next call of every kind goes to the driver
+	void invalidate()
+	{
+		program = unknown;
+		vertexArray = unknown;
+		activeUnit = unknown;
+		for (auto& unit : textures)
+			for (GLuint& texture : unit)
+				texture = unknown;
+		for (GLuint& buffer : buffers)
+			buffer = unknown;
+		for (std::int8_t& enabled : capabilities)
+			enabled = -1;
+		viewportValid = false;
+	}
+
+	void useProgram(GLuint ID)
+	{
+		if (changed(program, ID))
+			glUseProgram(ID);
+	}
+
+	void bindVertexArray(GLuint ID)
+	{
+		if (!changed(vertexArray, ID))
+			return;
+		glBindVertexArray(ID);
+		// the element buffer binding belongs to the VAO
+		buffers[bufferSlot(GL_ELEMENT_ARRAY_BUFFER)] = unknown;
+	}
+
+	// GL_TEXTURE0 + n
+	void activeTexture(GLenum unit)
+	{
+		if (changed(activeUnit, unit))
+			glActiveTexture(unit);
+	}
+
+	// Binds texture to unit, only switches the active unit when the binding actually changes
+	// so glTex* calls after it can end up on another unit, use bindTextureForEditing for those
+	void bindTexture(GLuint unit, GLenum target, GLuint texture)
+	{
+		int slot{ textureSlot(target) };
+		if (unit >= maxTextureUnits || slot < 0)
+		{
+			activeTexture(GL_TEXTURE0 + unit);
+			issue();
+			glBindTexture(target, texture);
+			return;
+		}
+
+		if (textures[unit][slot] == texture)
+		{
+			stats.elided++;
+			return;
+		}
+		activeTexture(GL_TEXTURE0 + unit);
+		issue();
+		glBindTexture(target, texture);
+		textures[unit][slot] = texture;
+	}
+
+	// Binds texture to whichever unit is active, so the glTex* calls that follow change it
+	void bindTextureForEditing(GLenum target, GLuint texture)
+	{
+		bindTexture(activeUnit == unknown ? 0 : activeUnit - GL_TEXTURE0, target, texture);
+	}
+
+	void bindBuffer(GLenum target, GLuint buffer)
+	{
+		int slot{ bufferSlot(target) };
+		if (slot < 0)
+		{
+			issue();
+			glBindBuffer(target, buffer);
+			return;
+		}
+		if (changed(buffers[slot], buffer))
+			glBindBuffer(target, buffer);
+	}
+
+	// Always issued (the indexed binding isn't tracked) but it also sets the generic binding
+	void bindBufferBase(GLenum target, GLuint index, GLuint buffer)
+	{
+		issue();
+		glBindBufferBase(target, index, buffer);
+		int slot{ bufferSlot(target) };
+		if (slot >= 0)
+			buffers[slot] = buffer;
+	}
+
+	// A deleted object is unbound everywhere, so the shadow has to forget it too
+	void forgetBuffer(GLuint buffer)
+	{
+		for (GLuint& bound : buffers)
+			if (bound == buffer)
+				bound = 0;
+	}
+
+	void forgetTexture(GLuint texture)
+	{
+		for (auto& unit : textures)
+			for (GLuint& bound : unit)
+				if (bound == texture)
+					bound = 0;
+	}
+
+	void enable(GLenum capability) { setEnabled(capability, true); }
+	void disable(GLenum capability) { setEnabled(capability, false); }
+
+	void setEnabled(GLenum capability, bool enabled)
+	{
+		int slot{ capabilitySlot(capability) };
+		if (slot >= 0 && capabilities[slot] == static_cast<std::int8_t>(enabled))
+		{
+			stats.elided++;
+			return;
+		}
+
+		issue();
+		if (enabled)
+			glEnable(capability);
+		else
+			glDisable(capability);
+		if (slot >= 0)
+			capabilities[slot] = static_cast<std::int8_t>(enabled);
+	}
+
+	void viewport(GLint x, GLint y, GLsizei width, GLsizei height)
+	{
+		if (viewportValid && viewportRect[0] == x && viewportRect[1] == y && viewportRect[2] == width && viewportRect[3] == height)
+		{
+			stats.elided++;
+			return;
+		}
+
+		issue();
+		glViewport(x, y, width, height);
+		viewportRect[0] = x;
+		viewportRect[1] = y;
+		viewportRect[2] = width;
+		viewportRect[3] = height;
+		viewportValid = true;
+	}
+
+private:
+	// nothing the driver hands out, so the first call always goes through
+	static constexpr GLuint unknown{ 0xFFFFFFFFu };
+
+	GLuint program;
+	GLuint vertexArray;
+	GLuint activeUnit;
+	GLuint textures[maxTextureUnits][3];
+	GLuint buffers[6];
+	// -1 unknown, 0 disabled, 1 enabled
+	std::int8_t capabilities[5];
+	GLint viewportRect[4]{};
+	bool viewportValid;
+
+	void issue() { stats.issued++; }
+
+	// Counts the call and updates the shadow, returns whether it has to be issued
+	bool changed(GLuint& current, GLuint value)
+	{
+		if (current == value)
+		{
+			stats.elided++;
+			return false;
+		}
+		current = value;
+		issue();
+		return true;
+	}
+
+	static int textureSlot(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_TEXTURE_2D: return 0;
+		case GL_TEXTURE_2D_ARRAY: return 1;
+		case GL_TEXTURE_CUBE_MAP: return 2;
+		default: return -1;
+		}
+	}
+
+	static int bufferSlot(GLenum target)
+	{
+		switch (target)
+		{
+		case GL_ARRAY_BUFFER: return 0;
+		case GL_ELEMENT_ARRAY_BUFFER: return 1;
+		case GL_UNIFORM_BUFFER: return 2;
+		case GL_PIXEL_UNPACK_BUFFER: return 3;
+		case GL_COPY_READ_BUFFER: return 4;
+		case GL_COPY_WRITE_BUFFER: return 5;
+		default: return -1;
+		}
+	}
+
+	static int capabilitySlot(GLenum capability)
+	{
+		switch (capability)
+		{
+		case GL_DEPTH_TEST: return 0;
+		case GL_CULL_FACE: return 1;
+		case GL_BLEND: return 2;
+		case GL_SCISSOR_TEST: return 3;
+		case GL_STENCIL_TEST: return 4;
+		default: return -1;
+		}
+	}
+};
+
+inline GLStateCache glState;
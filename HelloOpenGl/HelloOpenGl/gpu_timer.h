@@ -0,0 +1,232 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+// GPU time of named passes with GL_TIME_ELAPSED queries
+// Every frame gets its own set of queries from a ring gpuTimerFrames deep, a frame's results are
+// only read when its slot comes around again, by then the GPU has long finished it so the
+// read never waits. Results that still aren't available are dropped instead of stalling
+// Elapsed time queries can't nest, passes have to follow each other. A pass can run more than once
+// in a frame, every run gets its own query and the frame's time is their sum
+
+constexpr int gpuTimerFrames{ 4 };
+constexpr int maxGpuPasses{ 8 };
+// frames the rolling average goes over
+constexpr int gpuAverageWindow{ 60 };
+
+// One frame of the per frame log, negative when the pass didn't run or the result was dropped
+struct GpuFrameTimes
+{
+	int frame;
+	double milliseconds[maxGpuPasses];
+};
+
+class GpuTimer
+{
+public:
+	// Every result read back so far, oldest first
+	std::vector<GpuFrameTimes> log;
+
+	// Returns the index for name, adding the pass the first time
+	int pass(const std::string& name)
+	{
+		for (size_t i{ 0 }; i < names.size(); i++)
+			if (names[i] == name)
+				return static_cast<int>(i);
+		if (names.size() == maxGpuPasses)
+			return -1;
+
+		names.push_back(name);
+		history.emplace_back();
+		return static_cast<int>(names.size() - 1);
+	}
+
+	// Call before the first pass of a frame, collects the results of the frame that used this slot before
+	void beginFrame()
+	{
+		int slot{ frame % gpuTimerFrames };
+		collect(slot);
+		slotFrames[slot] = frame;
+	}
+
+	void endFrame()
+	{
+		if (active >= 0)
+			end();
+		frame++;
+	}
+
+	// Waits for and collects everything still in flight, for the end of a run
+	void flush()
+	{
+		glFinish();
+		for (int i{ 0 }; i < gpuTimerFrames; i++)
+			collect((frame + i) % gpuTimerFrames);
+	}
+
+	void begin(int pass)
+	{
+		if (pass < 0 || pass >= static_cast<int>(names.size()))
+			return;
+		if (active >= 0)
+			end();
+
+		int slot{ frame % gpuTimerFrames };
+		std::vector<GLuint>& runs{ queries[slot][pass] };
+		int run{ issued[slot][pass]++ };
+		if (run == static_cast<int>(runs.size()))
+		{
+			runs.push_back(0);
+			glGenQueries(1, &runs.back());
+		}
+
+		glBeginQuery(GL_TIME_ELAPSED, runs[run]);
+		active = pass;
+	}
+
+	void end()
+	{
+		if (active < 0)
+			return;
+		glEndQuery(GL_TIME_ELAPSED);
+		active = -1;
+	}
+
+	// Average over the last gpuAverageWindow results of the pass, 0 if there are none yet
+	double average(int pass) const
+	{
+		if (pass < 0 || pass >= static_cast<int>(history.size()) || history[pass].count == 0)
+			return 0.0;
+		return history[pass].sum / history[pass].count;
+	}
+
+	// Average over every result in the log
+	double mean(int pass) const
+	{
+		double sum{ 0.0 };
+		int count{ 0 };
+		for (const GpuFrameTimes& times : log)
+		{
+			if (times.milliseconds[pass] >= 0.0)
+			{
+				sum += times.milliseconds[pass];
+				count++;
+			}
+		}
+		return count ? sum / count : 0.0;
+	}
+
+	const std::vector<std::string>& passNames() const { return names; }
+
+	// The log as CSV, one row per frame, one column per pass
+	void writeLog(std::ostream& out) const
+	{
+		out << "frame";
+		for (const std::string& name : names)
+			out << ',' << name << "_ms";
+		out << '\n';
+
+		for (const GpuFrameTimes& times : log)
+		{
+			out << times.frame;
+			for (size_t pass{ 0 }; pass < names.size(); pass++)
+			{
+				out << ',';
+				if (times.milliseconds[pass] >= 0.0)
+					out << times.milliseconds[pass];
+			}
+			out << '\n';
+		}
+	}
+
+private:
+	struct RollingAverage
+	{
+		double values[gpuAverageWindow]{};
+		double sum{ 0.0 };
+		int count{ 0 };
+		int next{ 0 };
+
+		void add(double value)
+		{
+			if (count == gpuAverageWindow)
+				sum -= values[next];
+			else
+				count++;
+			values[next] = value;
+			sum += value;
+			next = (next + 1) % gpuAverageWindow;
+		}
+	};
+
+	std::vector<std::string> names;
+	std::vector<RollingAverage> history;
+
+	// one query per run of the pass in the frame, kept for the next frame that uses the slot
+	std::vector<GLuint> queries[gpuTimerFrames][maxGpuPasses];
+	// runs this frame
+	int issued[gpuTimerFrames][maxGpuPasses]{};
+	int slotFrames[gpuTimerFrames]{};
+	int frame{ 0 };
+	int active{ -1 };
+
+	void collect(int slot)
+	{
+		GpuFrameTimes times{ slotFrames[slot], {} };
+		bool any{ false };
+
+		for (int pass{ 0 }; pass < maxGpuPasses; pass++)
+		{
+			times.milliseconds[pass] = -1.0;
+			int runs{ issued[slot][pass] };
+			if (runs == 0)
+				continue;
+			issued[slot][pass] = 0;
+
+			// the last run finishes last, the others are done when it is
+			GLint available{ 0 };
+			glGetQueryObjectiv(queries[slot][pass][runs - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available)
+				continue;
+
+			GLuint64 total{ 0 };
+			for (int run{ 0 }; run < runs; run++)
+			{
+				GLuint64 nanoseconds{ 0 };
+				glGetQueryObjectui64v(queries[slot][pass][run], GL_QUERY_RESULT, &nanoseconds);
+				total += nanoseconds;
+			}
+			times.milliseconds[pass] = total / 1e6;
+			history[pass].add(times.milliseconds[pass]);
+			any = true;
+		}
+
+		if (any)
+			log.push_back(times);
+	}
+};
+
+// Times everything between construction and the end of the scope
+class GpuTimerScope
+{
+public:
+	GpuTimerScope(GpuTimer& timer, int pass) : timer{ timer }
+	{
+		timer.begin(pass);
+	}
+
+	~GpuTimerScope()
+	{
+		timer.end();
+	}
+
+	GpuTimerScope(const GpuTimerScope&) = delete;
+	GpuTimerScope& operator=(const GpuTimerScope&) = delete;
+
+private:
+	GpuTimer& timer;
+};
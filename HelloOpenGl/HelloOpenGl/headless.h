@@ -0,0 +1,167 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "gl_state.h"
+#include "gpu_timer.h"
+
+// Pieces of the --headless benchmark mode
+// The window is invisible (on the null platform with OSMesa when GLFW has it) so everything
+// is rendered into an FBO instead, time follows the frame number and the camera flies
+// a fixed path, so two runs on the same machine render exactly the same frames
+
+// frames rendered before measuring starts, the first ones compile shaders and upload everything
+constexpr int headlessWarmupFrames{ 3 };
+// simulated time step, independent of how long a frame takes
+constexpr float headlessTimeStep{ 1.0f / 60.0f };
+
+// Colour + depth renderbuffers the headless mode draws into
+class OffscreenTarget
+{
+public:
+	GLuint FBO{ 0 };
+	bool complete{ false };
+
+	OffscreenTarget(GLsizei width, GLsizei height)
+	{
+		glGenFramebuffers(1, &FBO);
+		glBindFramebuffer(GL_FRAMEBUFFER, FBO);
+
+		glGenRenderbuffers(2, renderbuffers);
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+
+		glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+
+		complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+		glState.viewport(0, 0, width, height);
+	}
+
+private:
+	GLuint renderbuffers[2]{};
+};
+
+// Where the camera is on a given frame, one slow orbit around the cubes every 600 frames
+// bobbing up and down, always looking at the middle of the scene
+struct CameraPose
+{
+	glm::vec3 position;
+	float yaw;
+	float pitch;
+};
+
+inline CameraPose cameraPathPose(int frame)
+{
+	const glm::vec3 centre{ 0.0f, 0.0f, -6.0f };
+	float angle{ glm::radians(360.0f) * static_cast<float>(frame % 600) / 600.0f };
+
+	glm::vec3 position{ centre + glm::vec3(std::sin(angle) * 10.0f, std::sin(angle * 2.0f) * 2.0f, std::cos(angle) * 10.0f) };
+	glm::vec3 direction{ glm::normalize(centre - position) };
+	return { position, glm::degrees(std::atan2(direction.z, direction.x)), glm::degrees(std::asin(direction.y)) };
+}
+
+// Parts of a frame the CPU time is split into
+enum FrameSection
+{
+	SectionUpdate,     // input and camera
+	SectionUniforms,   // clearing, light and camera uniform buffers
+	SectionTransforms, // instance matrices and their upload
+	SectionSubmit,     // filling and sorting the render queue
+	SectionExecute,    // issuing the draws
+	SectionPresent,    // stats, glFinish or swap
+	sectionCount,
+};
+
+constexpr const char* sectionNames[sectionCount]{ "update", "uniforms", "transforms", "submit", "execute", "present" };
+
+// Wall clock time of every frame and how it splits into sections
+// mark(section) charges the time since the previous mark to that section
+class FrameProfile
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	void beginFrame()
+	{
+		frameStart = Clock::now();
+		lastMark = frameStart;
+		std::fill(std::begin(current), std::end(current), 0.0);
+	}
+
+	void mark(FrameSection section)
+	{
+		Clock::time_point now{ Clock::now() };
+		current[section] += std::chrono::duration<double, std::milli>(now - lastMark).count();
+		lastMark = now;
+	}
+
+	// keep is false for frames that shouldn't count, like the warmup
+	void endFrame(bool keep)
+	{
+		if (!keep)
+			return;
+		frameTimes.push_back(std::chrono::duration<double, std::milli>(Clock::now() - frameStart).count());
+		for (int section{ 0 }; section < sectionCount; section++)
+			sectionTotals[section] += current[section];
+	}
+
+	size_t frames() const { return frameTimes.size(); }
+
+	// Everything in milliseconds, percentiles are nearest rank
+	// GPU times are the mean of every frame the timer has a result for
+	void writeJson(std::ostream& out, size_t cubeCount, const GpuTimer& gpuTimer) const
+	{
+		std::vector<double> sorted{ frameTimes };
+		std::sort(sorted.begin(), sorted.end());
+
+		double mean{ 0.0 };
+		for (double time : sorted)
+			mean += time;
+		mean /= std::max<size_t>(sorted.size(), 1);
+
+		auto percentile = [&sorted](double p) {
+			if (sorted.empty())
+				return 0.0;
+			size_t rank{ static_cast<size_t>(std::ceil(p / 100.0 * sorted.size())) };
+			return sorted[std::min(std::max<size_t>(rank, 1), sorted.size()) - 1];
+		};
+
+		out << "{\n";
+		out << "  \"frames\": " << sorted.size() << ",\n";
+		out << "  \"cubes\": " << cubeCount << ",\n";
+		out << "  \"frame_ms\": { \"mean\": " << mean << ", \"p50\": " << percentile(50.0) << ", \"p95\": " << percentile(95.0)
+			<< ", \"p99\": " << percentile(99.0) << ", \"max\": " << (sorted.empty() ? 0.0 : sorted.back()) << " },\n";
+		out << "  \"cpu_ms\": {";
+		for (int section{ 0 }; section < sectionCount; section++)
+		{
+			out << (section ? ", " : " ") << '"' << sectionNames[section] << "\": " << sectionTotals[section] / std::max<size_t>(sorted.size(), 1);
+		}
+		out << " },\n";
+		out << "  \"gpu_ms\": {";
+		const std::vector<std::string>& passes{ gpuTimer.passNames() };
+		for (size_t pass{ 0 }; pass < passes.size(); pass++)
+		{
+			out << (pass ? ", " : " ") << '"' << passes[pass] << "\": " << gpuTimer.mean(static_cast<int>(pass));
+		}
+		out << " }\n";
+		out << "}\n";
+	}
+
+private:
+	Clock::time_point frameStart;
+	Clock::time_point lastMark;
+	double current[sectionCount]{};
+	double sectionTotals[sectionCount]{};
+	std::vector<double> frameTimes;
+};
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstddef>
+#include <random>
+#include <vector>
+
+#include "gl_state.h"
+#include "transform.h"
+
+// Per instance transforms for glDrawArraysInstanced
+// The buffer is attached to a VAO as a mat4 model attribute (4 consecutive locations)
+// followed by the material layer (1 more)
+class InstanceBuffer
+{
+public:
+	GLuint ID;
+
+	InstanceBuffer(GLuint vao, GLuint firstAttribute) : firstAttribute{ firstAttribute }
+	{
+		glGenBuffers(1, &ID);
+
+		glState.bindVertexArray(vao);
+		glState.bindBuffer(GL_ARRAY_BUFFER, ID);
+
+		// one column per location, advanced once per instance instead of once per vertex
+		for (GLuint attribute{ firstAttribute }; attribute < firstAttribute + attributeCount; attribute++)
+		{
+			glEnableVertexAttribArray(attribute);
+			glVertexAttribDivisor(attribute, 1);
+		}
+		pointAttributes(0);
+	}
+
+	// GL 3.3 has no base instance for instanced draws, so drawing instances from first on
+	// points vao's attributes at that instance instead
+	void setFirstInstance(GLuint vao, size_t first)
+	{
+		glState.bindVertexArray(vao);
+		glState.bindBuffer(GL_ARRAY_BUFFER, ID);
+		pointAttributes(sizeof(InstanceTransform) * first);
+	}
+
+	// Replaces the contents with count instances
+	void upload(const InstanceTransform* instances, size_t count)
+	{
+		glState.bindBuffer(GL_ARRAY_BUFFER, ID);
+
+		GLsizeiptr size{ static_cast<GLsizeiptr>(sizeof(InstanceTransform) * count) };
+		if (count > capacity)
+		{
+			capacity = count;
+			glBufferData(GL_ARRAY_BUFFER, size, instances, GL_STREAM_DRAW);
+			return;
+		}
+
+		// orphan the old storage so we don't wait for draws that still read it
+		glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(sizeof(InstanceTransform) * capacity), nullptr, GL_STREAM_DRAW);
+		glBufferSubData(GL_ARRAY_BUFFER, 0, size, instances);
+	}
+
+private:
+	size_t capacity{ 0 };
+
+	// model and material
+	static constexpr GLuint attributeCount{ 5 };
+
+	GLuint firstAttribute;
+
+	// Attribute pointers of the bound VAO, base is the byte offset of the first instance
+	void pointAttributes(size_t base)
+	{
+		for (GLuint column{ 0 }; column < 4; column++)
+		{
+			size_t offset{ base + offsetof(InstanceTransform, model) + sizeof(glm::vec4) * column };
+			glVertexAttribPointer(firstAttribute + column, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceTransform), (void*)offset);
+		}
+		// an integer attribute, so it takes the I variant
+		size_t material{ base + offsetof(InstanceTransform, material) };
+		glVertexAttribIPointer(firstAttribute + 4, 1, GL_UNSIGNED_INT, sizeof(InstanceTransform), (void*)material);
+	}
+};
+
+// Random cube positions for --stress, seeded so every run draws the same scene
+inline std::vector<glm::vec3> stressPositions(size_t count, float extent)
+{
+	std::mt19937 random(1234);
+	std::uniform_real_distribution<float> coordinate(-extent, extent);
+
+	std::vector<glm::vec3> positions(count);
+	for (glm::vec3& position : positions)
+		position = glm::vec3(coordinate(random), coordinate(random), coordinate(random));
+	return positions;
+}
@@ -0,0 +1,214 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read only view of a whole file, mmap on POSIX and a file mapping on Windows
+// The bytes are the page cache itself, nothing is copied onto the heap
+// Move only, the view goes away with the object
+class MappedFile
+{
+public:
+	MappedFile() = default;
+
+	explicit MappedFile(const std::string& path)
+	{
+		open(path);
+	}
+
+	~MappedFile()
+	{
+		close();
+	}
+
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	MappedFile(MappedFile&& other) noexcept
+	{
+		*this = static_cast<MappedFile&&>(other);
+	}
+
+	MappedFile& operator=(MappedFile&& other) noexcept
+	{
+		if (this == &other)
+			return *this;
+		close();
+		bytes = other.bytes;
+		length = other.length;
+		other.bytes = nullptr;
+		other.length = 0;
+#ifdef _WIN32
+		file = other.file;
+		mapping = other.mapping;
+		other.file = INVALID_HANDLE_VALUE;
+		other.mapping = nullptr;
+#endif
+		return *this;
+	}
+
+	bool open(const std::string& path)
+	{
+		close();
+#ifdef _WIN32
+		file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			return false;
+		LARGE_INTEGER fileSize;
+		if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0)
+		{
+			close();
+			return false;
+		}
+		mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (!mapping)
+		{
+			close();
+			return false;
+		}
+		bytes = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+		if (!bytes)
+		{
+			close();
+			return false;
+		}
+		length = static_cast<size_t>(fileSize.QuadPart);
+#else
+		int descriptor{ ::open(path.c_str(), O_RDONLY) };
+		if (descriptor < 0)
+			return false;
+		struct stat info;
+		if (fstat(descriptor, &info) != 0 || info.st_size == 0)
+		{
+			::close(descriptor);
+			return false;
+		}
+		void* view{ mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0) };
+		// the mapping keeps the file alive on its own
+		::close(descriptor);
+		if (view == MAP_FAILED)
+			return false;
+		bytes = static_cast<const std::uint8_t*>(view);
+		length = static_cast<size_t>(info.st_size);
+#endif
+		return true;
+	}
+
+	void close()
+	{
+#ifdef _WIN32
+		if (bytes)
+			UnmapViewOfFile(bytes);
+		if (mapping)
+			CloseHandle(mapping);
+		if (file != INVALID_HANDLE_VALUE)
+			CloseHandle(file);
+		mapping = nullptr;
+		file = INVALID_HANDLE_VALUE;
+#else
+		if (bytes)
+			munmap(const_cast<std::uint8_t*>(bytes), length);
+#endif
+		bytes = nullptr;
+		length = 0;
+	}
+
+	// Reads one byte of every page, so the disk reads happen here (on a worker)
+	// and not inside whatever GL call gets the pointer later
+	void prefetch() const
+	{
+		constexpr size_t pageSize{ 4096 };
+		volatile std::uint8_t sink{ 0 };
+		for (size_t offset{ 0 }; offset < length; offset += pageSize)
+			sink = sink + bytes[offset];
+	}
+
+	const std::uint8_t* data() const { return bytes; }
+	size_t size() const { return length; }
+	bool isOpen() const { return bytes != nullptr; }
+
+private:
+	const std::uint8_t* bytes{ nullptr };
+	size_t length{ 0 };
+#ifdef _WIN32
+	HANDLE file{ INVALID_HANDLE_VALUE };
+	HANDLE mapping{ nullptr };
+#endif
+};
+
+#ifndef _WIN32
+
+// Share of the file's pages that are in the page cache, -1 when mincore can't tell
+inline double residentFraction(int descriptor)
+{
+	struct stat info;
+	if (fstat(descriptor, &info) != 0 || info.st_size == 0)
+		return -1.0;
+	size_t length{ static_cast<size_t>(info.st_size) };
+	// only mapped, never touched, so this doesn't read anything in
+	void* view{ mmap(nullptr, length, PROT_READ, MAP_SHARED, descriptor, 0) };
+	if (view == MAP_FAILED)
+		return -1.0;
+
+	size_t page{ static_cast<size_t>(sysconf(_SC_PAGESIZE)) };
+	size_t pages{ (length + page - 1) / page };
+#ifdef __APPLE__
+	std::vector<char> residency(pages);
+#else
+	std::vector<unsigned char> residency(pages);
+#endif
+	double fraction{ -1.0 };
+	if (mincore(view, length, residency.data()) == 0)
+	{
+		size_t resident{ 0 };
+		for (auto flags : residency)
+			resident += flags & 1;
+		fraction = static_cast<double>(resident) / pages;
+	}
+	munmap(view, length);
+	return fraction;
+}
+
+#endif
+
+// Asks the OS to drop the file from the page cache so the next read comes off the disk
+// Only for benchmarking cold loads. Returns how much of the file is still cached afterwards,
+// 0 to 1, or -1 where that isn't possible or can't be checked
+inline double evictFromPageCache(const std::string& path)
+{
+#ifdef _WIN32
+	// Windows has no per file equivalent
+	(void)path;
+	return -1.0;
+#else
+	int descriptor{ ::open(path.c_str(), O_RDONLY) };
+	if (descriptor < 0)
+		return -1.0;
+	double resident{ -1.0 };
+#ifdef POSIX_FADV_DONTNEED
+	// dirty pages aren't dropped, a file that was just written has to reach the disk first
+	::fsync(descriptor);
+	if (posix_fadvise(descriptor, 0, 0, POSIX_FADV_DONTNEED) == 0)
+		resident = residentFraction(descriptor);
+#endif
+	::close(descriptor);
+	return resident;
+#endif
+}
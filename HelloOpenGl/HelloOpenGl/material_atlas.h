@@ -0,0 +1,128 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "gl_state.h"
+#include "mip_generator.h"
+#include "profiler.h"
+#include "stb_image.h"
+#include "texture_loader.h"
+#include "thread_pool.h"
+
+// Every material's diffuse and specular map as one layer of two GL_TEXTURE_2D_ARRAYs
+// A cube picks its layer with a per instance attribute, so any number of materials
+// draw with the same two bindings in one instanced draw call
+// All layers share one size, the first diffuse map's. Images of another size are resampled to it
+
+struct MaterialTextures
+{
+	std::string diffuse;
+	// empty for no specular at all
+	std::string specular;
+};
+
+class MaterialAtlas
+{
+public:
+	GLuint diffuse{ 0 };
+	GLuint specular{ 0 };
+	int width{ 0 };
+	int height{ 0 };
+	// 0 when nothing could be loaded
+	int layers{ 0 };
+
+	// Decodes and builds the mip chains on the workers, blocks until every layer is uploaded
+	MaterialAtlas(ThreadPool& pool, const std::vector<MaterialTextures>& materials)
+	{
+		PROFILE_ZONE("material atlas");
+		if (materials.empty())
+			return;
+
+		int channels;
+		if (!stbi_info(materials.front().diffuse.c_str(), &width, &height, &channels))
+		{
+			std::cerr << "FAILED to create texture " << materials.front().diffuse << '\n';
+			return;
+		}
+		layers = static_cast<int>(materials.size());
+
+		// one slot per layer, so the workers never touch the same vector element
+		std::vector<std::vector<TextureLevel>> diffuseChains(materials.size());
+		std::vector<std::vector<TextureLevel>> specularChains(materials.size());
+		for (size_t i{ 0 }; i < materials.size(); i++)
+		{
+			pool.submit([this, &materials, &diffuseChains, i] {
+				diffuseChains[i] = layerChain(materials[i].diffuse, TextureColorSpace::SRGB);
+			});
+			pool.submit([this, &materials, &specularChains, i] {
+				specularChains[i] = layerChain(materials[i].specular, TextureColorSpace::Linear);
+			});
+		}
+		pool.wait();
+
+		diffuse = upload(diffuseChains);
+		specular = upload(specularChains);
+	}
+
+	// false when the first diffuse map couldn't be read, there are no layers then
+	bool loaded() const { return layers > 0; }
+
+private:
+	// Mip chain of one layer, black when there is no image
+	std::vector<TextureLevel> layerChain(const std::string& path, TextureColorSpace colorSpace) const
+	{
+		PROFILE_ZONE("material layer");
+		TextureLevel base{ width, height, std::vector<std::uint8_t>(static_cast<size_t>(width) * height * 4, 0) };
+
+		if (!path.empty())
+		{
+			stbi_set_flip_vertically_on_load_thread(true);
+			int w, h, channels;
+			unsigned char* data{ stbi_load(path.c_str(), &w, &h, &channels, 4) };
+			if (data)
+			{
+				TextureLevel image{ w, h, std::vector<std::uint8_t>(data, data + static_cast<size_t>(w) * h * 4) };
+				stbi_image_free(data);
+				base = resizeLevel(image, width, height, defaultTextureMipFilter, colorSpace);
+			}
+			else
+			{
+				std::cerr << "FAILED to create texture " << path << '\n';
+			}
+		}
+		return generateMipChain(std::move(base), defaultTextureMipFilter, colorSpace);
+	}
+
+	GLuint upload(const std::vector<std::vector<TextureLevel>>& chains)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glState.bindTextureForEditing(GL_TEXTURE_2D_ARRAY, texture);
+
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		// every chain has the same levels, they all start from width x height
+		const std::vector<TextureLevel>& levels{ chains.front() };
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levels.size() - 1));
+		for (size_t level{ 0 }; level < levels.size(); level++)
+		{
+			GLint mip{ static_cast<GLint>(level) };
+			glTexImage3D(GL_TEXTURE_2D_ARRAY, mip, GL_RGBA8, levels[level].width, levels[level].height, layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+			for (int layer{ 0 }; layer < layers; layer++)
+			{
+				const TextureLevel& image{ chains[layer][level] };
+				glTexSubImage3D(GL_TEXTURE_2D_ARRAY, mip, 0, 0, layer, image.width, image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.data.data());
+			}
+		}
+		return texture;
+	}
+};
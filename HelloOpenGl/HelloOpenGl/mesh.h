@@ -0,0 +1,306 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "gl_state.h"
+
+// Indexed mesh built from a non indexed triangle list
+// 1. weld identical vertices with a hash table
+// 2. reorder triangles for the post transform vertex cache (Tipsify, Sander et al. 2007)
+// 3. reorder clusters of triangles so outward facing ones come first, which cuts overdraw
+// 4. reorder vertices in the order the index buffer first uses them
+// Every vertex starts with its position as 3 floats
+
+constexpr int vertexCacheSize{ 16 };
+
+struct Mesh
+{
+	std::vector<float> vertices;
+	std::vector<std::uint32_t> indices;
+	int floatsPerVertex{ 0 };
+
+	size_t vertexCount() const { return vertices.size() / floatsPerVertex; }
+	size_t triangleCount() const { return indices.size() / 3; }
+
+	glm::vec3 position(std::uint32_t vertex) const
+	{
+		const float* v{ &vertices[static_cast<size_t>(vertex) * floatsPerVertex] };
+		return glm::vec3(v[0], v[1], v[2]);
+	}
+};
+
+// FNV-1a over the raw bytes of one vertex, identical vertices are bit for bit identical
+inline std::uint32_t hashVertex(const float* vertex, int floatsPerVertex)
+{
+	std::uint32_t hash{ 2166136261u };
+	const unsigned char* bytes{ reinterpret_cast<const unsigned char*>(vertex) };
+	for (size_t i{ 0 }; i < sizeof(float) * floatsPerVertex; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Step 1, every vertex of the triangle list either matches one we already have or becomes a new one
+inline Mesh weldVertices(const float* vertices, size_t vertexCount, int floatsPerVertex)
+{
+	Mesh mesh;
+	mesh.floatsPerVertex = floatsPerVertex;
+	mesh.indices.reserve(vertexCount);
+
+	// open addressing table of indices into mesh.vertices, load factor at most one half
+	constexpr std::uint32_t empty{ 0xFFFFFFFFu };
+	size_t capacity{ 16 };
+	while (capacity < vertexCount * 2)
+		capacity *= 2;
+	std::vector<std::uint32_t> table(capacity, empty);
+	size_t mask{ capacity - 1 };
+
+	size_t vertexBytes{ sizeof(float) * floatsPerVertex };
+	for (size_t i{ 0 }; i < vertexCount; i++)
+	{
+		const float* vertex{ vertices + i * floatsPerVertex };
+		size_t slot{ hashVertex(vertex, floatsPerVertex) & mask };
+		while (table[slot] != empty && std::memcmp(&mesh.vertices[static_cast<size_t>(table[slot]) * floatsPerVertex], vertex, vertexBytes) != 0)
+			slot = (slot + 1) & mask;
+
+		if (table[slot] == empty)
+		{
+			table[slot] = static_cast<std::uint32_t>(mesh.vertexCount());
+			mesh.vertices.insert(mesh.vertices.end(), vertex, vertex + floatsPerVertex);
+		}
+		mesh.indices.push_back(table[slot]);
+	}
+
+	return mesh;
+}
+
+// Average cache miss ratio (misses per triangle) and average transform to vertex ratio (misses per vertex)
+// for a FIFO cache like the hardware has, a non indexed list always gets ACMR 3
+struct CacheStats
+{
+	double acmr;
+	double atvr;
+};
+
+inline CacheStats simulateVertexCache(const std::vector<std::uint32_t>& indices, size_t vertexCount, int cacheSize = vertexCacheSize)
+{
+	// a vertex is still in the FIFO if fewer than cacheSize misses happened since it was loaded
+	std::vector<long long> loadedAt(vertexCount, -cacheSize - 1LL);
+	long long misses{ 0 };
+
+	for (std::uint32_t index : indices)
+	{
+		if (misses - loadedAt[index] > cacheSize)
+		{
+			loadedAt[index] = misses;
+			misses++;
+		}
+	}
+
+	double triangles{ static_cast<double>(indices.size() / 3) };
+	return { misses / triangles, misses / static_cast<double>(vertexCount) };
+}
+
+// Step 2 and 3, Tipsify: fan around a vertex while its neighbours are still in the cache,
+// jump somewhere else when the fan runs dry. Every jump starts a new cluster for the overdraw sort
+inline void optimizeTriangleOrder(Mesh& mesh, int cacheSize = vertexCacheSize)
+{
+	size_t vertexCount{ mesh.vertexCount() };
+	size_t triangleCount{ mesh.triangleCount() };
+	const std::vector<std::uint32_t>& indices{ mesh.indices };
+
+	// triangles using each vertex, flattened
+	std::vector<std::uint32_t> liveTriangles(vertexCount, 0);
+	for (std::uint32_t index : indices)
+		liveTriangles[index]++;
+
+	std::vector<std::uint32_t> adjacencyStart(vertexCount + 1, 0);
+	for (size_t v{ 0 }; v < vertexCount; v++)
+		adjacencyStart[v + 1] = adjacencyStart[v] + liveTriangles[v];
+
+	std::vector<std::uint32_t> adjacency(indices.size());
+	std::vector<std::uint32_t> fill(adjacencyStart.begin(), adjacencyStart.end() - 1);
+	for (size_t i{ 0 }; i < indices.size(); i++)
+		adjacency[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+
+	std::vector<long long> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<std::uint32_t> deadEnds;
+	std::vector<std::uint32_t> candidates;
+
+	std::vector<std::uint32_t> order;
+	order.reserve(triangleCount);
+	// first triangle of every cluster in order
+	std::vector<size_t> clusterStarts{ 0 };
+
+	long long time{ cacheSize + 1LL };
+	size_t cursor{ 0 };
+	long long fanning{ vertexCount > 0 ? 0 : -1 };
+
+	while (fanning >= 0)
+	{
+		candidates.clear();
+
+		for (std::uint32_t a{ adjacencyStart[fanning] }; a < adjacencyStart[fanning + 1]; a++)
+		{
+			std::uint32_t triangle{ adjacency[a] };
+			if (emitted[triangle])
+				continue;
+
+			for (int corner{ 0 }; corner < 3; corner++)
+			{
+				std::uint32_t v{ indices[triangle * 3 + corner] };
+				deadEnds.push_back(v);
+				candidates.push_back(v);
+				liveTriangles[v]--;
+				if (time - cacheTime[v] > cacheSize)
+				{
+					cacheTime[v] = time;
+					time++;
+				}
+			}
+			emitted[triangle] = true;
+			order.push_back(triangle);
+		}
+
+		// the candidate that is still in the cache after its remaining triangles are emitted, oldest first
+		long long next{ -1 };
+		long long best{ -1 };
+		for (std::uint32_t v : candidates)
+		{
+			if (liveTriangles[v] == 0)
+				continue;
+
+			long long priority{ 0 };
+			if (time - cacheTime[v] + 2LL * liveTriangles[v] <= cacheSize)
+				priority = time - cacheTime[v];
+			if (priority > best)
+			{
+				best = priority;
+				next = v;
+			}
+		}
+
+		if (next < 0)
+		{
+			// dead end, go back to a recent vertex or scan forward for any vertex with triangles left
+			while (!deadEnds.empty() && next < 0)
+			{
+				std::uint32_t v{ deadEnds.back() };
+				deadEnds.pop_back();
+				if (liveTriangles[v] > 0)
+					next = v;
+			}
+			while (next < 0 && cursor < vertexCount)
+			{
+				if (liveTriangles[cursor] > 0)
+					next = static_cast<long long>(cursor);
+				cursor++;
+			}
+
+			if (next >= 0 && order.size() > clusterStarts.back())
+				clusterStarts.push_back(order.size());
+		}
+
+		fanning = next;
+	}
+	clusterStarts.push_back(order.size());
+
+	// Overdraw: clusters facing away from the mesh centre are the ones most likely in front, draw them first
+	glm::vec3 meshCentre{ 0.0f };
+	for (size_t v{ 0 }; v < vertexCount; v++)
+		meshCentre += mesh.position(static_cast<std::uint32_t>(v));
+	meshCentre /= static_cast<float>(std::max<size_t>(vertexCount, 1));
+
+	struct Cluster
+	{
+		size_t first;
+		size_t last;
+		float outwardness;
+	};
+	std::vector<Cluster> clusters;
+	for (size_t c{ 0 }; c + 1 < clusterStarts.size(); c++)
+	{
+		glm::vec3 centre{ 0.0f };
+		glm::vec3 normal{ 0.0f };
+		for (size_t t{ clusterStarts[c] }; t < clusterStarts[c + 1]; t++)
+		{
+			glm::vec3 a{ mesh.position(indices[order[t] * 3]) };
+			glm::vec3 b{ mesh.position(indices[order[t] * 3 + 1]) };
+			glm::vec3 d{ mesh.position(indices[order[t] * 3 + 2]) };
+			centre += a + b + d;
+			// area weighted
+			normal += glm::cross(b - a, d - a);
+		}
+		centre /= 3.0f * (clusterStarts[c + 1] - clusterStarts[c]);
+		clusters.push_back({ clusterStarts[c], clusterStarts[c + 1], glm::dot(centre - meshCentre, normal) });
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const Cluster& a, const Cluster& b) { return a.outwardness > b.outwardness; });
+
+	std::vector<std::uint32_t> sorted;
+	sorted.reserve(indices.size());
+	for (const Cluster& cluster : clusters)
+	{
+		for (size_t t{ cluster.first }; t < cluster.last; t++)
+			sorted.insert(sorted.end(), &indices[order[t] * 3], &indices[order[t] * 3] + 3);
+	}
+	mesh.indices = std::move(sorted);
+}
+
+// Step 4, vertices in the order they're first used so the vertex fetch walks memory forwards
+inline void optimizeVertexOrder(Mesh& mesh)
+{
+	constexpr std::uint32_t unused{ 0xFFFFFFFFu };
+	std::vector<std::uint32_t> remap(mesh.vertexCount(), unused);
+	std::vector<float> vertices;
+	vertices.reserve(mesh.vertices.size());
+
+	for (std::uint32_t& index : mesh.indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = static_cast<std::uint32_t>(vertices.size() / mesh.floatsPerVertex);
+			const float* vertex{ &mesh.vertices[static_cast<size_t>(index) * mesh.floatsPerVertex] };
+			vertices.insert(vertices.end(), vertex, vertex + mesh.floatsPerVertex);
+		}
+		index = remap[index];
+	}
+	mesh.vertices = std::move(vertices);
+}
+
+// The whole build step for a non indexed triangle list
+inline Mesh buildMesh(const float* vertices, size_t vertexCount, int floatsPerVertex)
+{
+	Mesh mesh{ weldVertices(vertices, vertexCount, floatsPerVertex) };
+	optimizeTriangleOrder(mesh);
+	optimizeVertexOrder(mesh);
+	return mesh;
+}
+
+// Uploads the indices into a new element buffer bound to the current VAO, 16 bit when they fit
+// Returns the index type glDrawElements needs
+inline GLenum uploadIndices(const Mesh& mesh, GLuint& EBO)
+{
+	glGenBuffers(1, &EBO);
+	glState.bindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+
+	if (mesh.vertexCount() <= 0xFFFF)
+	{
+		std::vector<std::uint16_t> shortIndices(mesh.indices.size());
+		for (size_t i{ 0 }; i < mesh.indices.size(); i++)
+			shortIndices[i] = static_cast<std::uint16_t>(mesh.indices[i]);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(std::uint16_t) * shortIndices.size(), shortIndices.data(), GL_STATIC_DRAW);
+		return GL_UNSIGNED_SHORT;
+	}
+
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(std::uint32_t) * mesh.indices.size(), mesh.indices.data(), GL_STATIC_DRAW);
+	return GL_UNSIGNED_INT;
+}
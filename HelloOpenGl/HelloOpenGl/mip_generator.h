@@ -0,0 +1,383 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#include "texture_file.h"
+
+// Mip chains built on the CPU instead of glGenerateMipmap
+// Every level is filtered from the one above it in float, separably (rows, then columns),
+// with a polyphase kernel so odd sizes come out right too. Colour maps are filtered in linear
+// light and encoded back to sRGB, data maps (specular, normals) are filtered as they are
+// The filter loops use AVX when compiled with /arch:AVX (-mavx) or better, SSE2 otherwise,
+// and a scalar loop for anything without SSE2
+
+#if defined(__AVX__)
+#define MIPMAP_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define MIPMAP_SSE2
+#include <emmintrin.h>
+#endif
+
+enum class MipFilter
+{
+	Box,     // 2x2 average
+	Kaiser,  // Kaiser windowed sinc, radius 2, alpha 4
+	Lanczos, // Lanczos 3
+};
+
+enum class TextureColorSpace
+{
+	SRGB,   // colour maps, filtered in linear light
+	Linear, // everything else
+};
+
+namespace mipmap
+{
+	constexpr float pi{ 3.14159265f };
+	constexpr float kaiserRadius{ 2.0f };
+	constexpr float kaiserAlpha{ 4.0f };
+	constexpr float lanczosRadius{ 3.0f };
+
+	inline float sinc(float x)
+	{
+		if (std::abs(x) < 1e-6f)
+			return 1.0f;
+		x *= pi;
+		return std::sin(x) / x;
+	}
+
+	// Modified Bessel function of the first kind, order 0, from its power series
+	inline float besselI0(float x)
+	{
+		float sum{ 1.0f };
+		float term{ 1.0f };
+		for (int k{ 1 }; k < 32 && term > sum * 1e-8f; k++)
+		{
+			term *= (x * 0.5f / k) * (x * 0.5f / k);
+			sum += term;
+		}
+		return sum;
+	}
+
+	// In destination texels
+	inline float kernelRadius(MipFilter filter)
+	{
+		switch (filter)
+		{
+		case MipFilter::Kaiser: return kaiserRadius;
+		case MipFilter::Lanczos: return lanczosRadius;
+		default: return 0.5f;
+		}
+	}
+
+	inline float kernelWeight(MipFilter filter, float x)
+	{
+		x = std::abs(x);
+		switch (filter)
+		{
+		case MipFilter::Kaiser:
+		{
+			if (x >= kaiserRadius)
+				return 0.0f;
+			float t{ x / kaiserRadius };
+			return sinc(x) * besselI0(kaiserAlpha * std::sqrt(1.0f - t * t)) / besselI0(kaiserAlpha);
+		}
+		case MipFilter::Lanczos:
+			return x < lanczosRadius ? sinc(x) * sinc(x / lanczosRadius) : 0.0f;
+		default:
+			return x <= 0.5f ? 1.0f : 0.0f;
+		}
+	}
+
+	// Source texels and weights for every destination texel along one axis, taps per texel
+	// Indices are clamped to the edge, unused taps have weight 0
+	struct FilterTaps
+	{
+		int size{ 0 };
+		int taps{ 0 };
+		std::vector<int> indices;
+		std::vector<float> weights;
+	};
+
+	inline FilterTaps filterTaps(MipFilter filter, int sourceSize, int destinationSize)
+	{
+		float scale{ static_cast<float>(sourceSize) / destinationSize };
+		// the kernel widens with the scale when shrinking, and stays one texel wide when enlarging
+		float stretch{ std::max(scale, 1.0f) };
+		float radius{ kernelRadius(filter) * stretch };
+
+		FilterTaps result;
+		result.size = destinationSize;
+		// the widest footprint over all destination texels
+		for (int x{ 0 }; x < destinationSize; x++)
+		{
+			float center{ (x + 0.5f) * scale - 0.5f };
+			int first{ static_cast<int>(std::ceil(center - radius)) };
+			int last{ static_cast<int>(std::floor(center + radius)) };
+			result.taps = std::max(result.taps, last - first + 1);
+		}
+
+		result.indices.assign(static_cast<size_t>(destinationSize) * result.taps, 0);
+		result.weights.assign(static_cast<size_t>(destinationSize) * result.taps, 0.0f);
+		for (int x{ 0 }; x < destinationSize; x++)
+		{
+			float center{ (x + 0.5f) * scale - 0.5f };
+			int first{ static_cast<int>(std::ceil(center - radius)) };
+			int* indices{ &result.indices[static_cast<size_t>(x) * result.taps] };
+			float* weights{ &result.weights[static_cast<size_t>(x) * result.taps] };
+
+			float total{ 0.0f };
+			for (int k{ 0 }; k < result.taps; k++)
+			{
+				indices[k] = std::min(std::max(first + k, 0), sourceSize - 1);
+				weights[k] = kernelWeight(filter, (first + k - center) / stretch);
+				total += weights[k];
+			}
+			for (int k{ 0 }; k < result.taps; k++)
+				weights[k] /= total;
+		}
+		return result;
+	}
+
+	inline float srgbToLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	inline float linearToSrgb(float value)
+	{
+		return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+	}
+
+	// Byte to float, straight table lookups
+	inline const float* srgbDecodeTable()
+	{
+		static const std::vector<float> table{ [] {
+			std::vector<float> values(256);
+			for (int i{ 0 }; i < 256; i++)
+				values[i] = srgbToLinear(i / 255.0f);
+			return values;
+		}() };
+		return table.data();
+	}
+
+	inline const float* unormDecodeTable()
+	{
+		static const std::vector<float> table{ [] {
+			std::vector<float> values(256);
+			for (int i{ 0 }; i < 256; i++)
+				values[i] = i / 255.0f;
+			return values;
+		}() };
+		return table.data();
+	}
+
+	// Linear float to byte, 4096 steps is enough to hit every sRGB byte
+	constexpr int srgbEncodeSteps{ 4096 };
+
+	inline const std::uint8_t* srgbEncodeTable()
+	{
+		static const std::vector<std::uint8_t> table{ [] {
+			std::vector<std::uint8_t> values(srgbEncodeSteps);
+			for (int i{ 0 }; i < srgbEncodeSteps; i++)
+				values[i] = static_cast<std::uint8_t>(linearToSrgb(static_cast<float>(i) / (srgbEncodeSteps - 1)) * 255.0f + 0.5f);
+			return values;
+		}() };
+		return table.data();
+	}
+
+	inline std::vector<float> toFloat(const TextureLevel& level, TextureColorSpace colorSpace)
+	{
+		const float* color{ colorSpace == TextureColorSpace::SRGB ? srgbDecodeTable() : unormDecodeTable() };
+		// alpha is never gamma encoded
+		const float* alpha{ unormDecodeTable() };
+
+		std::vector<float> pixels(level.data.size());
+		for (size_t i{ 0 }; i < level.data.size(); i += 4)
+		{
+			pixels[i] = color[level.data[i]];
+			pixels[i + 1] = color[level.data[i + 1]];
+			pixels[i + 2] = color[level.data[i + 2]];
+			pixels[i + 3] = alpha[level.data[i + 3]];
+		}
+		return pixels;
+	}
+
+	inline TextureLevel toBytes(const std::vector<float>& pixels, int width, int height, TextureColorSpace colorSpace)
+	{
+		const std::uint8_t* encode{ srgbEncodeTable() };
+		// Kaiser and Lanczos ring, so values can land a little outside 0..1
+		auto unorm = [](float value, float steps) { return static_cast<int>(std::min(std::max(value, 0.0f), 1.0f) * steps + 0.5f); };
+
+		TextureLevel level{ width, height, std::vector<std::uint8_t>(pixels.size()) };
+		for (size_t i{ 0 }; i < pixels.size(); i += 4)
+		{
+			if (colorSpace == TextureColorSpace::SRGB)
+			{
+				for (size_t c{ 0 }; c < 3; c++)
+					level.data[i + c] = encode[unorm(pixels[i + c], srgbEncodeSteps - 1)];
+			}
+			else
+			{
+				for (size_t c{ 0 }; c < 3; c++)
+					level.data[i + c] = static_cast<std::uint8_t>(unorm(pixels[i + c], 255.0f));
+			}
+			level.data[i + 3] = static_cast<std::uint8_t>(unorm(pixels[i + 3], 255.0f));
+		}
+		return level;
+	}
+
+	// RGBA rows of sourceWidth texels to rows of taps.size texels
+	// One texel is 4 floats, exactly one SSE register
+	inline void filterRows(const float* source, int sourceWidth, int height, const FilterTaps& taps, float* destination, bool simd)
+	{
+		for (int y{ 0 }; y < height; y++)
+		{
+			const float* row{ source + static_cast<size_t>(y) * sourceWidth * 4 };
+			float* out{ destination + static_cast<size_t>(y) * taps.size * 4 };
+			for (int x{ 0 }; x < taps.size; x++)
+			{
+				const int* indices{ &taps.indices[static_cast<size_t>(x) * taps.taps] };
+				const float* weights{ &taps.weights[static_cast<size_t>(x) * taps.taps] };
+#if defined(MIPMAP_AVX) || defined(MIPMAP_SSE2)
+				if (simd)
+				{
+					// two sums so each add doesn't wait on the one before
+					__m128 even{ _mm_setzero_ps() };
+					__m128 odd{ _mm_setzero_ps() };
+					int k{ 0 };
+					for (; k + 2 <= taps.taps; k += 2)
+					{
+						even = _mm_add_ps(even, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(row + indices[k] * 4)));
+						odd = _mm_add_ps(odd, _mm_mul_ps(_mm_set1_ps(weights[k + 1]), _mm_loadu_ps(row + indices[k + 1] * 4)));
+					}
+					if (k < taps.taps)
+						even = _mm_add_ps(even, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(row + indices[k] * 4)));
+					_mm_storeu_ps(out + x * 4, _mm_add_ps(even, odd));
+					continue;
+				}
+#endif
+				float sum[4]{};
+				for (int k{ 0 }; k < taps.taps; k++)
+					for (int c{ 0 }; c < 4; c++)
+						sum[c] += weights[k] * row[indices[k] * 4 + c];
+				std::copy(sum, sum + 4, out + x * 4);
+			}
+		}
+	}
+
+	// Rows of width texels to taps.size rows, a weighted sum of whole rows so it runs along x
+	inline void filterColumns(const float* source, int width, const FilterTaps& taps, float* destination, bool simd)
+	{
+		size_t floats{ static_cast<size_t>(width) * 4 };
+		for (int y{ 0 }; y < taps.size; y++)
+		{
+			const int* indices{ &taps.indices[static_cast<size_t>(y) * taps.taps] };
+			const float* weights{ &taps.weights[static_cast<size_t>(y) * taps.taps] };
+			float* out{ destination + y * floats };
+			// rows are whole texels, so with SSE there's never anything left for the scalar loop
+			size_t done{ 0 };
+
+#if defined(MIPMAP_AVX)
+			if (simd)
+			{
+				size_t end{ floats - floats % 8 };
+				for (size_t i{ 0 }; i < end; i += 8)
+				{
+					__m256 sum{ _mm256_setzero_ps() };
+					for (int k{ 0 }; k < taps.taps; k++)
+						sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(weights[k]), _mm256_loadu_ps(source + indices[k] * floats + i)));
+					_mm256_storeu_ps(out + i, sum);
+				}
+				done = end;
+			}
+#endif
+#if defined(MIPMAP_AVX) || defined(MIPMAP_SSE2)
+			if (simd)
+			{
+				size_t end{ floats - floats % 4 };
+				for (size_t i{ done }; i < end; i += 4)
+				{
+					__m128 sum{ _mm_setzero_ps() };
+					for (int k{ 0 }; k < taps.taps; k++)
+						sum = _mm_add_ps(sum, _mm_mul_ps(_mm_set1_ps(weights[k]), _mm_loadu_ps(source + indices[k] * floats + i)));
+					_mm_storeu_ps(out + i, sum);
+				}
+				done = end;
+			}
+#endif
+			for (size_t i{ done }; i < floats; i++)
+			{
+				float sum{ 0.0f };
+				for (int k{ 0 }; k < taps.taps; k++)
+					sum += weights[k] * source[indices[k] * floats + i];
+				out[i] = sum;
+			}
+		}
+	}
+}
+
+// Full chain down to 1x1 from an RGBA8 base level, which is kept as level 0
+// simd = false forces the scalar loops, only for benchmarking
+inline std::vector<TextureLevel> generateMipChain(TextureLevel base, MipFilter filter, TextureColorSpace colorSpace, bool simd = true)
+{
+	using namespace mipmap;
+
+	std::vector<TextureLevel> chain;
+	int width{ base.width };
+	int height{ base.height };
+	std::vector<float> current{ toFloat(base, colorSpace) };
+	chain.push_back(std::move(base));
+
+	std::vector<float> rows;
+	std::vector<float> next;
+	while (width > 1 || height > 1)
+	{
+		int nextWidth{ std::max(width / 2, 1) };
+		int nextHeight{ std::max(height / 2, 1) };
+
+		rows.resize(static_cast<size_t>(nextWidth) * height * 4);
+		filterRows(current.data(), width, height, filterTaps(filter, width, nextWidth), rows.data(), simd);
+		next.resize(static_cast<size_t>(nextWidth) * nextHeight * 4);
+		filterColumns(rows.data(), nextWidth, filterTaps(filter, height, nextHeight), next.data(), simd);
+
+		// the next level is filtered from the float result, so rounding doesn't add up down the chain
+		chain.push_back(toBytes(next, nextWidth, nextHeight, colorSpace));
+		std::swap(current, next);
+		width = nextWidth;
+		height = nextHeight;
+	}
+	return chain;
+}
+
+// Resamples source to width x height with the same filters, for packing differently sized images together
+inline TextureLevel resizeLevel(const TextureLevel& source, int width, int height, MipFilter filter, TextureColorSpace colorSpace)
+{
+	using namespace mipmap;
+
+	if (source.width == width && source.height == height)
+		return source;
+
+	std::vector<float> pixels{ toFloat(source, colorSpace) };
+	std::vector<float> rows(static_cast<size_t>(width) * source.height * 4);
+	filterRows(pixels.data(), source.width, source.height, filterTaps(filter, source.width, width), rows.data(), true);
+	std::vector<float> resized(static_cast<size_t>(width) * height * 4);
+	filterColumns(rows.data(), width, filterTaps(filter, source.height, height), resized.data(), true);
+	return toBytes(resized, width, height, colorSpace);
+}
+
+// Which kernel generateMipChain uses, for printing
+inline const char* mipKernelName()
+{
+#if defined(MIPMAP_AVX)
+	return "AVX";
+#elif defined(MIPMAP_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
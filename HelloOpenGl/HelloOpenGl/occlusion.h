@@ -0,0 +1,461 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "bounds.h"
+#include "profiler.h"
+#include "thread_pool.h"
+
+// Software occlusion culling
+// A few big, close objects (the occluders) are rasterized on the CPU into a small depth buffer,
+// then everything else is tested against it as a screen rectangle at the depth of its nearest
+// point. Whatever is behind the occluders everywhere never reaches the GPU.
+// Depth is 1 / w (bigger is closer), it's linear in screen space so it interpolates without
+// any perspective correction, and 0 is "nothing drawn here". Every 8x8 tile keeps the
+// farthest depth in it, most tests end at the tiles and never look at single pixels.
+// Errs on the visible side: occluders only cover the pixels that are entirely inside them and take
+// the farthest depth anywhere in the pixel, occludees cover every pixel they touch. So a gap between
+// two occluders, however thin, leaves at least the pixels it runs through empty
+// Rows of tiles are spread over the ThreadPool, the rows of a triangle are filled 8 pixels at
+// a time with AVX (/arch:AVX, -mavx), 4 with SSE2, or one by one without either.
+// No GL anywhere in here
+
+#if defined(__AVX__)
+#define OCCLUSION_AVX
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE2
+#include <emmintrin.h>
+#endif
+
+// Counted since begin()
+struct OcclusionStats
+{
+	unsigned int occluders{ 0 };
+	unsigned int triangles{ 0 };
+	unsigned int tested{ 0 };
+	unsigned int occluded{ 0 };
+};
+
+class OcclusionBuffer
+{
+public:
+	static constexpr int tileSize{ 8 };
+
+	OcclusionStats stats;
+
+	// Rounded up to whole tiles
+	OcclusionBuffer(int width = 256, int height = 160)
+		: bufferWidth{ (width + tileSize - 1) / tileSize * tileSize }, bufferHeight{ (height + tileSize - 1) / tileSize * tileSize },
+		tilesX{ bufferWidth / tileSize }, tilesY{ bufferHeight / tileSize },
+		depth(static_cast<size_t>(bufferWidth) * bufferHeight, 0.0f), tiles(static_cast<size_t>(tilesX) * tilesY, 0.0f)
+	{
+	}
+
+	// Starts a frame, nothing is drawn until rasterize()
+	void begin(const glm::mat4& viewProjection)
+	{
+		clip = viewProjection;
+		triangles.clear();
+		stats = {};
+	}
+
+	// Triangle list, positions in model space
+	void addMesh(const glm::mat4& model, const glm::vec3* positions, const std::uint32_t* indices, size_t indexCount)
+	{
+		glm::mat4 transform{ clip * model };
+		for (size_t i{ 0 }; i + 2 < indexCount; i += 3)
+		{
+			glm::vec4 corners[3];
+			for (int corner{ 0 }; corner < 3; corner++)
+				corners[corner] = transform * glm::vec4(positions[indices[i + corner]], 1.0f);
+			addClipTriangle(corners);
+		}
+		stats.occluders++;
+	}
+
+	// A unit cube (-0.5 to 0.5) placed by model, like the cubes in the scene
+	void addBox(const glm::mat4& model)
+	{
+		static const glm::vec3 corners[8]{
+			{ -0.5f, -0.5f, -0.5f }, { 0.5f, -0.5f, -0.5f }, { 0.5f, 0.5f, -0.5f }, { -0.5f, 0.5f, -0.5f },
+			{ -0.5f, -0.5f, 0.5f }, { 0.5f, -0.5f, 0.5f }, { 0.5f, 0.5f, 0.5f }, { -0.5f, 0.5f, 0.5f },
+		};
+		static const std::uint32_t indices[36]{
+			0, 1, 2, 0, 2, 3, // back
+			4, 6, 5, 4, 7, 6, // front
+			0, 3, 7, 0, 7, 4, // left
+			1, 5, 6, 1, 6, 2, // right
+			0, 4, 5, 0, 5, 1, // bottom
+			3, 2, 6, 3, 6, 7, // top
+		};
+		addMesh(model, corners, indices, 36);
+	}
+
+	// Clears and draws everything added since begin(), then builds the tiles
+	// The calling thread takes rows too, so it works without a pool, and a pool busy with other jobs
+	// (texture decodes queue up there) only leaves it more rows to do. It only waits for rows a helper
+	// is in the middle of, a helper job that starts after every row is taken finds nothing to do
+	void rasterize(ThreadPool* pool = nullptr, bool simd = true)
+	{
+		PROFILE_ZONE("occlusion rasterize");
+		useSimd = simd;
+
+		// the counters outlive this call, a helper that runs late only ever touches them
+		auto rows{ std::make_shared<RowCounters>() };
+		rows->count = tilesY;
+		int helpers{ pool ? static_cast<int>(std::min<size_t>(pool->size(), static_cast<size_t>(tilesY - 1))) : 0 };
+		for (int i{ 0 }; i < helpers; i++)
+		{
+			pool->submit([this, rows] {
+				PROFILE_ZONE("occlusion rows");
+				rasterizeRows(*rows);
+			});
+		}
+		rasterizeRows(*rows);
+
+		while (rows->finished.load() < rows->count)
+			std::this_thread::yield();
+	}
+
+	// False when the box is behind the occluders everywhere it covers on screen
+	bool visible(const Aabb& box)
+	{
+		stats.tested++;
+
+		float nearest{ 0.0f };
+		glm::vec2 low{ std::numeric_limits<float>::max() };
+		glm::vec2 high{ -std::numeric_limits<float>::max() };
+		for (int corner{ 0 }; corner < 8; corner++)
+		{
+			glm::vec3 p{ corner & 1 ? box.max.x : box.min.x, corner & 2 ? box.max.y : box.min.y, corner & 4 ? box.max.z : box.min.z };
+			glm::vec4 c{ clip * glm::vec4(p, 1.0f) };
+			// crosses the near plane, the rectangle would be wrong and it's right in front of the camera anyway
+			if (c.z < -c.w)
+				return true;
+			glm::vec2 screen{ toScreen(c) };
+			low = glm::min(low, screen);
+			high = glm::max(high, screen);
+			nearest = std::max(nearest, 1.0f / c.w);
+		}
+
+		int x0{ std::max(0, static_cast<int>(std::floor(low.x))) };
+		int y0{ std::max(0, static_cast<int>(std::floor(low.y))) };
+		int x1{ std::min(bufferWidth - 1, static_cast<int>(std::floor(high.x))) };
+		int y1{ std::min(bufferHeight - 1, static_cast<int>(std::floor(high.y))) };
+		// off screen, that's for the frustum to decide
+		if (x0 > x1 || y0 > y1)
+			return true;
+
+		for (int ty{ y0 / tileSize }; ty <= y1 / tileSize; ty++)
+		{
+			for (int tx{ x0 / tileSize }; tx <= x1 / tileSize; tx++)
+			{
+				// everything in the tile is closer than the box
+				if (tiles[ty * tilesX + tx] > nearest)
+					continue;
+
+				int rowEnd{ std::min(y1, ty * tileSize + tileSize - 1) };
+				int columnEnd{ std::min(x1, tx * tileSize + tileSize - 1) };
+				for (int y{ std::max(y0, ty * tileSize) }; y <= rowEnd; y++)
+				{
+					const float* row{ depth.data() + static_cast<size_t>(y) * bufferWidth };
+					for (int x{ std::max(x0, tx * tileSize) }; x <= columnEnd; x++)
+					{
+						if (row[x] <= nearest)
+							return true;
+					}
+				}
+			}
+		}
+
+		stats.occluded++;
+		return false;
+	}
+
+	int width() const { return bufferWidth; }
+	int height() const { return bufferHeight; }
+	// 1 / w per pixel, bottom row first, 0 where no occluder is
+	const std::vector<float>& depthBuffer() const { return depth; }
+
+private:
+	// Screen space triangle, edge i is inside where edge[i].x * x + edge[i].y * y + edge[i].z >= 0
+	// and depth there is depthPlane.x * x + depthPlane.y * y + depthPlane.z
+	struct Triangle
+	{
+		glm::vec3 edges[3];
+		glm::vec3 depthPlane;
+		// no pixel of the triangle is farther than this
+		float farthest;
+		int minX, maxX, minY, maxY;
+	};
+
+	int bufferWidth;
+	int bufferHeight;
+	int tilesX;
+	int tilesY;
+	std::vector<float> depth;
+	// farthest depth in every tile
+	std::vector<float> tiles;
+
+	glm::mat4 clip{ 1.0f };
+	std::vector<Triangle> triangles;
+	bool useSimd{ true };
+
+	// Tile rows of one rasterize() call
+	struct RowCounters
+	{
+		int count{ 0 };
+		// next row nobody has taken yet
+		std::atomic<int> next{ 0 };
+		std::atomic<int> finished{ 0 };
+	};
+
+	glm::vec2 toScreen(const glm::vec4& c) const
+	{
+		return { (c.x / c.w * 0.5f + 0.5f) * bufferWidth, (c.y / c.w * 0.5f + 0.5f) * bufferHeight };
+	}
+
+	// Cuts the triangle at the near plane (z = -w), that leaves nothing, one or two triangles
+	void addClipTriangle(const glm::vec4 (&corners)[3])
+	{
+		glm::vec4 polygon[4];
+		int count{ 0 };
+		for (int i{ 0 }; i < 3; i++)
+		{
+			const glm::vec4& a{ corners[i] };
+			const glm::vec4& b{ corners[(i + 1) % 3] };
+			float da{ a.z + a.w };
+			float db{ b.z + b.w };
+			if (da >= 0.0f)
+				polygon[count++] = a;
+			if ((da >= 0.0f) != (db >= 0.0f))
+				polygon[count++] = a + (b - a) * (da / (da - db));
+		}
+		for (int i{ 2 }; i < count; i++)
+			setup(polygon[0], polygon[i - 1], polygon[i]);
+	}
+
+	void setup(const glm::vec4& a, const glm::vec4& b, const glm::vec4& c)
+	{
+		// clipping at the near plane keeps w positive
+		glm::vec3 v[3]{
+			glm::vec3(toScreen(a), 1.0f / a.w),
+			glm::vec3(toScreen(b), 1.0f / b.w),
+			glm::vec3(toScreen(c), 1.0f / c.w),
+		};
+
+		Triangle triangle;
+		triangle.minX = std::max(0, static_cast<int>(std::floor(std::min({ v[0].x, v[1].x, v[2].x }))));
+		triangle.minY = std::max(0, static_cast<int>(std::floor(std::min({ v[0].y, v[1].y, v[2].y }))));
+		triangle.maxX = std::min(bufferWidth - 1, static_cast<int>(std::floor(std::max({ v[0].x, v[1].x, v[2].x }))));
+		triangle.maxY = std::min(bufferHeight - 1, static_cast<int>(std::floor(std::max({ v[0].y, v[1].y, v[2].y }))));
+		if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+			return;
+
+		// edge i is opposite vertex i, either winding works, the signs get flipped to the same one
+		float area{ 0.0f };
+		for (int i{ 0 }; i < 3; i++)
+		{
+			const glm::vec3& from{ v[(i + 1) % 3] };
+			const glm::vec3& to{ v[(i + 2) % 3] };
+			triangle.edges[i] = { from.y - to.y, to.x - from.x, from.x * to.y - from.y * to.x };
+			area += triangle.edges[i].z;
+		}
+		if (area == 0.0f)
+			return;
+		if (area < 0.0f)
+		{
+			for (glm::vec3& edge : triangle.edges)
+				edge = -edge;
+			area = -area;
+		}
+		// the depth plane needs the exact edges, the coverage test gets them pulled in by half a pixel so
+		// a pixel counts when all of it is inside, not just its center
+		glm::vec3 exact[3]{ triangle.edges[0], triangle.edges[1], triangle.edges[2] };
+		for (glm::vec3& edge : triangle.edges)
+			edge.z -= 0.5f * (std::abs(edge.x) + std::abs(edge.y));
+
+		// depth is the barycentric blend of the corners, and the barycentrics are the edges over the area
+		triangle.depthPlane = (exact[0] * v[0].z + exact[1] * v[1].z + exact[2] * v[2].z) / area;
+		// value at the pixel center minus how much it can drop within half a pixel
+		triangle.depthPlane.z -= 0.5f * (std::abs(triangle.depthPlane.x) + std::abs(triangle.depthPlane.y));
+		triangle.farthest = std::min({ v[0].z, v[1].z, v[2].z });
+
+		triangles.push_back(triangle);
+		stats.triangles++;
+	}
+
+	// Takes rows until there are none left, this object is only touched for a row that was taken
+	void rasterizeRows(RowCounters& rows)
+	{
+		for (int tileRow{ rows.next.fetch_add(1) }; tileRow < rows.count; tileRow = rows.next.fetch_add(1))
+		{
+			int top{ tileRow * tileSize };
+			int bottom{ top + tileSize - 1 };
+			std::fill(depth.begin() + static_cast<size_t>(top) * bufferWidth, depth.begin() + static_cast<size_t>(bottom + 1) * bufferWidth, 0.0f);
+
+			for (const Triangle& triangle : triangles)
+			{
+				if (triangle.maxY < top || triangle.minY > bottom)
+					continue;
+				int rowEnd{ std::min(bottom, triangle.maxY) };
+				for (int y{ std::max(top, triangle.minY) }; y <= rowEnd; y++)
+					fillSpan(triangle, y);
+			}
+
+			buildTiles(tileRow);
+			rows.finished.fetch_add(1);
+		}
+	}
+
+	void fillSpan(const Triangle& triangle, int y)
+	{
+		float* row{ depth.data() + static_cast<size_t>(y) * bufferWidth };
+#if defined(OCCLUSION_AVX)
+		if (useSimd)
+			return fillSpanAVX(triangle, y, row);
+#elif defined(OCCLUSION_SSE2)
+		if (useSimd)
+			return fillSpanSSE(triangle, y, row);
+#endif
+		fillSpanScalar(triangle, y, row);
+	}
+
+	void fillSpanScalar(const Triangle& triangle, int y, float* row) const
+	{
+		float py{ y + 0.5f };
+		for (int x{ triangle.minX }; x <= triangle.maxX; x++)
+		{
+			float px{ x + 0.5f };
+			bool inside{ true };
+			// same order of operations as the SIMD kernels, so they agree on pixels right on an edge
+			for (const glm::vec3& edge : triangle.edges)
+				inside = inside && edge.x * px + (edge.y * py + edge.z) >= 0.0f;
+			if (!inside)
+				continue;
+			float z{ std::max(triangle.farthest, triangle.depthPlane.x * px + triangle.depthPlane.y * py + triangle.depthPlane.z) };
+			row[x] = std::max(row[x], z);
+		}
+	}
+
+#if defined(OCCLUSION_SSE2)
+
+	// The buffer width is a multiple of 8, so starting at a multiple of 4 never runs past the row
+	void fillSpanSSE(const Triangle& triangle, int y, float* row) const
+	{
+		float py{ y + 0.5f };
+		int first{ triangle.minX & ~3 };
+		__m128 lanes{ _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f) };
+		__m128 x{ _mm_add_ps(_mm_set1_ps(static_cast<float>(first)), lanes) };
+		__m128 minX{ _mm_set1_ps(static_cast<float>(triangle.minX)) };
+		__m128 maxX{ _mm_set1_ps(triangle.maxX + 1.0f) };
+
+		// the edges are evaluated at every pixel rather than stepped, stepping drifts and a pixel right on
+		// an edge could come out differently than in the scalar loop. The depth is stepped
+		__m128 edgeX[3];
+		__m128 edgeRow[3];
+		for (int i{ 0 }; i < 3; i++)
+		{
+			const glm::vec3& e{ triangle.edges[i] };
+			edgeX[i] = _mm_set1_ps(e.x);
+			edgeRow[i] = _mm_set1_ps(e.y * py + e.z);
+		}
+		const glm::vec3& plane{ triangle.depthPlane };
+		__m128 z{ _mm_add_ps(_mm_mul_ps(_mm_set1_ps(plane.x), x), _mm_set1_ps(plane.y * py + plane.z)) };
+		__m128 zStep{ _mm_set1_ps(plane.x * 4.0f) };
+		__m128 farthest{ _mm_set1_ps(triangle.farthest) };
+		__m128 four{ _mm_set1_ps(4.0f) };
+		__m128 zero{ _mm_setzero_ps() };
+
+		for (int start{ first }; start <= triangle.maxX; start += 4)
+		{
+			__m128 inside{ _mm_and_ps(_mm_cmpge_ps(x, minX), _mm_cmplt_ps(x, maxX)) };
+			for (int i{ 0 }; i < 3; i++)
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX[i], x), edgeRow[i]), zero));
+			// depth is never negative, so zeroing the pixels outside makes max() leave them alone
+			__m128 covered{ _mm_and_ps(inside, _mm_max_ps(z, farthest)) };
+			_mm_storeu_ps(row + start, _mm_max_ps(_mm_loadu_ps(row + start), covered));
+			z = _mm_add_ps(z, zStep);
+			x = _mm_add_ps(x, four);
+		}
+	}
+
+#endif
+
+#if defined(OCCLUSION_AVX)
+
+	void fillSpanAVX(const Triangle& triangle, int y, float* row) const
+	{
+		float py{ y + 0.5f };
+		int first{ triangle.minX & ~7 };
+		__m256 lanes{ _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f) };
+		__m256 x{ _mm256_add_ps(_mm256_set1_ps(static_cast<float>(first)), lanes) };
+		__m256 minX{ _mm256_set1_ps(static_cast<float>(triangle.minX)) };
+		__m256 maxX{ _mm256_set1_ps(triangle.maxX + 1.0f) };
+
+		__m256 edgeX[3];
+		__m256 edgeRow[3];
+		for (int i{ 0 }; i < 3; i++)
+		{
+			const glm::vec3& e{ triangle.edges[i] };
+			edgeX[i] = _mm256_set1_ps(e.x);
+			edgeRow[i] = _mm256_set1_ps(e.y * py + e.z);
+		}
+		const glm::vec3& plane{ triangle.depthPlane };
+		__m256 z{ _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(plane.x), x), _mm256_set1_ps(plane.y * py + plane.z)) };
+		__m256 zStep{ _mm256_set1_ps(plane.x * 8.0f) };
+		__m256 farthest{ _mm256_set1_ps(triangle.farthest) };
+		__m256 eight{ _mm256_set1_ps(8.0f) };
+		__m256 zero{ _mm256_setzero_ps() };
+
+		for (int start{ first }; start <= triangle.maxX; start += 8)
+		{
+			__m256 inside{ _mm256_and_ps(_mm256_cmp_ps(x, minX, _CMP_GE_OQ), _mm256_cmp_ps(x, maxX, _CMP_LT_OQ)) };
+			for (int i{ 0 }; i < 3; i++)
+				inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(_mm256_mul_ps(edgeX[i], x), edgeRow[i]), zero, _CMP_GE_OQ));
+			__m256 covered{ _mm256_and_ps(inside, _mm256_max_ps(z, farthest)) };
+			_mm256_storeu_ps(row + start, _mm256_max_ps(_mm256_loadu_ps(row + start), covered));
+			z = _mm256_add_ps(z, zStep);
+			x = _mm256_add_ps(x, eight);
+		}
+	}
+
+#endif
+
+	void buildTiles(int tileRow)
+	{
+		for (int tx{ 0 }; tx < tilesX; tx++)
+		{
+			float farthest{ std::numeric_limits<float>::max() };
+			for (int y{ tileRow * tileSize }; y < tileRow * tileSize + tileSize; y++)
+			{
+				const float* row{ depth.data() + static_cast<size_t>(y) * bufferWidth + tx * tileSize };
+				for (int x{ 0 }; x < tileSize; x++)
+					farthest = std::min(farthest, row[x]);
+			}
+			tiles[tileRow * tilesX + tx] = farthest;
+		}
+	}
+};
+
+// Which kernel fills the occluder spans, for printing
+inline const char* occlusionKernelName()
+{
+#if defined(OCCLUSION_AVX)
+	return "AVX";
+#elif defined(OCCLUSION_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
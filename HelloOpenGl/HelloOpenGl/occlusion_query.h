@@ -0,0 +1,163 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <vector>
+
+// Hardware occlusion queries for groups of objects
+// Every group gets a GL_ANY_SAMPLES_PASSED query that wraps a draw of its bounding box (the proxy,
+// no color or depth writes), and the group itself is drawn inside glBeginConditionalRender on that
+// query, so the GPU drops it when no sample of the box passed. The CPU never waits for a result:
+// queries are polled at the start of the frame and whatever came back decides the next frames.
+//  - a group that was visible is drawn plainly for revisitInterval frames, then tested again
+//  - a hidden group is tested again every frame its last query has come back, and drawn conditionally
+//    on the newest query it has, so it shows up again as soon as the GPU sees the box
+// The plain draws go first so the tested groups have something in the depth buffer to be hidden by
+// A result that comes back a frame or two late only costs a wasted draw or a group showing up a frame
+// late, never a group that stays missing
+
+struct OcclusionQueryStats
+{
+	unsigned int queriesIssued{ 0 };
+	unsigned int resultsRead{ 0 };
+	// groups the last result said were hidden
+	unsigned int hidden{ 0 };
+	unsigned int plainDraws{ 0 };
+	unsigned int conditionalDraws{ 0 };
+};
+
+class OcclusionQueries
+{
+public:
+	OcclusionQueryStats stats;
+	// frames a visible group is trusted for before it's tested again
+	int revisitInterval{ 8 };
+
+	OcclusionQueries() = default;
+	OcclusionQueries(const OcclusionQueries&) = delete;
+	OcclusionQueries& operator=(const OcclusionQueries&) = delete;
+
+	~OcclusionQueries()
+	{
+		for (Group& group : groups)
+			if (group.query != 0)
+				glDeleteQueries(1, &group.query);
+	}
+
+	void resize(size_t count)
+	{
+		groups.resize(count);
+	}
+
+	size_t size() const { return groups.size(); }
+
+	// Start of the frame, reads every result that's available and leaves the rest in flight
+	void beginFrame()
+	{
+		frame++;
+		stats = {};
+		for (Group& group : groups)
+		{
+			if (group.pending)
+			{
+				GLuint available{ 0 };
+				glGetQueryObjectuiv(group.query, GL_QUERY_RESULT_AVAILABLE, &available);
+				if (available)
+				{
+					GLuint passed{ 0 };
+					glGetQueryObjectuiv(group.query, GL_QUERY_RESULT, &passed);
+					group.visible = passed != 0;
+					group.pending = false;
+					stats.resultsRead++;
+				}
+			}
+			stats.hidden += !group.visible;
+		}
+	}
+
+	// Whether group gets a proxy draw this frame
+	bool needsQuery(size_t group) const
+	{
+		const Group& state{ groups[group] };
+		return !state.pending && (!state.visible || frame - state.testedFrame >= revisitInterval);
+	}
+
+	// Turns color and depth writes off for the proxies, the depth test stays on
+	void beginProxies()
+	{
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		glDepthMask(GL_FALSE);
+	}
+
+	void endProxies()
+	{
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+		glDepthMask(GL_TRUE);
+	}
+
+	// Runs drawProxy inside a new query for group, between beginProxies and endProxies
+	template <typename DrawProxy>
+	void query(size_t group, DrawProxy drawProxy)
+	{
+		Group& state{ groups[group] };
+		if (state.query == 0)
+			glGenQueries(1, &state.query);
+
+		glBeginQuery(GL_ANY_SAMPLES_PASSED, state.query);
+		drawProxy();
+		glEndQuery(GL_ANY_SAMPLES_PASSED);
+
+		state.pending = true;
+		state.testedFrame = frame;
+		stats.queriesIssued++;
+	}
+
+	// Whether group is drawn without a condition this frame, it was visible and isn't up for a test
+	// Doesn't change between the plain draws, the proxies and the conditional draws
+	bool trusted(size_t group) const
+	{
+		const Group& state{ groups[group] };
+		return state.visible && state.testedFrame != frame && !needsQuery(group);
+	}
+
+	// For a group whose proxy can't be trusted, like one the camera is inside of (its box gets clipped away)
+	// Counts as seen on the last frame, so it's drawn plainly until revisitInterval frames after that stops
+	void assumeVisible(size_t group)
+	{
+		Group& state{ groups[group] };
+		state.visible = true;
+		state.testedFrame = frame - 1;
+	}
+
+	// Runs drawGroup, under its newest query unless it's trusted
+	// NO_WAIT draws it anyway when the GPU doesn't have the result by then
+	template <typename DrawGroup>
+	void draw(size_t group, DrawGroup drawGroup)
+	{
+		if (trusted(group))
+		{
+			drawGroup();
+			stats.plainDraws++;
+			return;
+		}
+
+		glBeginConditionalRender(groups[group].query, GL_QUERY_NO_WAIT);
+		drawGroup();
+		glEndConditionalRender();
+		stats.conditionalDraws++;
+	}
+
+private:
+	struct Group
+	{
+		GLuint query{ 0 };
+		// new groups are assumed visible, the first test is due right away
+		bool visible{ true };
+		bool pending{ false };
+		std::int64_t testedFrame{ -1000000 };
+	};
+
+	std::vector<Group> groups;
+	std::int64_t frame{ 0 };
+};
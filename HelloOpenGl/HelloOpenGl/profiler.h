@@ -0,0 +1,194 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <vector>
+
+// Scoped CPU zones written out as Chrome trace_event JSON (chrome://tracing or ui.perfetto.dev)
+//   PROFILE_ZONE("name");  times from here to the end of the scope, zones nest
+// Every thread appends to its own buffer, only the thread itself writes to it and publishes
+// the count with a release store, so recording takes no locks. The mutex is only taken
+// the first time a thread records and when the trace is written
+// Build with PROFILER_ENABLED 0 and the macros compile to nothing
+
+#ifndef PROFILER_ENABLED
+#define PROFILER_ENABLED 1
+#endif
+
+struct ProfileEvent
+{
+	const char* name; // has to outlive the profiler, string literals only
+	std::uint64_t start;
+	std::uint64_t duration;
+};
+
+class Profiler
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	// Nothing is recorded until this is set, so an unused profiler costs one branch per zone
+	std::atomic<bool> enabled{ false };
+
+	std::uint64_t now() const
+	{
+		return static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - epoch).count());
+	}
+
+	void record(const char* name, std::uint64_t start, std::uint64_t end)
+	{
+		threadBuffer().push({ name, start, end - start });
+	}
+
+	// Shows up as the thread's name in the viewer, call from the thread itself
+	void nameThread(const char* name)
+	{
+		ThreadBuffer& buffer{ threadBuffer() };
+		std::lock_guard<std::mutex> lock{ mutex };
+		buffer.name = name;
+	}
+
+	// Can be called while other threads keep recording, it only sees what they had published
+	void writeChromeTrace(std::ostream& out)
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+
+		out << "{\"traceEvents\":[\n";
+		bool first{ true };
+		for (size_t thread{ 0 }; thread < threads.size(); thread++)
+		{
+			const ThreadBuffer& buffer{ *threads[thread] };
+			if (buffer.name)
+			{
+				out << (first ? "" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << thread
+					<< ",\"args\":{\"name\":\"" << buffer.name << "\"}}";
+				first = false;
+			}
+
+			size_t count{ buffer.count.load(std::memory_order_acquire) };
+			for (size_t i{ 0 }; i < count; i++)
+			{
+				const ProfileEvent& event{ buffer.at(i) };
+				// microseconds with nanosecond decimals
+				out << (first ? "" : ",\n") << "{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << thread
+					<< ",\"ts\":" << event.start / 1000 << '.' << fraction(event.start)
+					<< ",\"dur\":" << event.duration / 1000 << '.' << fraction(event.duration) << '}';
+				first = false;
+			}
+		}
+		out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	}
+
+private:
+	static constexpr size_t chunkSize{ 4096 };
+
+	struct Chunk
+	{
+		ProfileEvent events[chunkSize];
+	};
+
+	// Chunks are never moved or freed while the program runs, so a reader can follow them
+	// while the owner keeps appending new ones
+	struct ThreadBuffer
+	{
+		std::vector<std::unique_ptr<Chunk>> chunks;
+		std::atomic<size_t> count{ 0 };
+		const char* name{ nullptr };
+
+		ThreadBuffer()
+		{
+			chunks.reserve(4096);
+		}
+
+		void push(const ProfileEvent& event)
+		{
+			size_t index{ count.load(std::memory_order_relaxed) };
+			if (index / chunkSize == chunks.size())
+			{
+				// a full chunk list would move, past this the thread just stops recording
+				if (chunks.size() == chunks.capacity())
+					return;
+				chunks.push_back(std::make_unique<Chunk>());
+			}
+			chunks[index / chunkSize]->events[index % chunkSize] = event;
+			count.store(index + 1, std::memory_order_release);
+		}
+
+		const ProfileEvent& at(size_t index) const
+		{
+			return chunks[index / chunkSize]->events[index % chunkSize];
+		}
+	};
+
+	Clock::time_point epoch{ Clock::now() };
+	std::mutex mutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> threads;
+
+	// The calling thread's buffer, created the first time it asks
+	ThreadBuffer& threadBuffer()
+	{
+		thread_local ThreadBuffer* buffer{ nullptr };
+		if (!buffer)
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			threads.push_back(std::make_unique<ThreadBuffer>());
+			buffer = threads.back().get();
+		}
+		return *buffer;
+	}
+
+	// three digits after the decimal point
+	struct Fraction
+	{
+		std::uint64_t nanoseconds;
+	};
+
+	static Fraction fraction(std::uint64_t nanoseconds) { return { nanoseconds % 1000 }; }
+
+	friend std::ostream& operator<<(std::ostream& out, Fraction value)
+	{
+		std::uint64_t digits{ value.nanoseconds };
+		return out << static_cast<char>('0' + digits / 100) << static_cast<char>('0' + digits / 10 % 10) << static_cast<char>('0' + digits % 10);
+	}
+};
+
+inline Profiler profiler;
+
+// Records one zone when it goes out of scope
+class ProfileZone
+{
+public:
+	explicit ProfileZone(const char* name) : name{ name }
+	{
+		if (profiler.enabled.load(std::memory_order_relaxed))
+			start = profiler.now();
+	}
+
+	~ProfileZone()
+	{
+		if (start != notRecording)
+			profiler.record(name, start, profiler.now());
+	}
+
+	ProfileZone(const ProfileZone&) = delete;
+	ProfileZone& operator=(const ProfileZone&) = delete;
+
+private:
+	static constexpr std::uint64_t notRecording{ ~0ull };
+
+	const char* name;
+	std::uint64_t start{ notRecording };
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#if PROFILER_ENABLED
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__){ name }
+#else
+#define PROFILE_ZONE(name) ((void)0)
+#endif
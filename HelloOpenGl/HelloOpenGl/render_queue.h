@@ -0,0 +1,212 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "gl_state.h"
+#include "gpu_timer.h"
+#include "profiler.h"
+#include "shader.h"
+
+// Draws are submitted as packets with a 64 bit key, radix sorted once per frame and then executed
+// Key layout, most significant first:
+//   pass 2 | program 8 | texture set 10 | VAO 8 | depth 24 | submission order 12
+// so sorting groups draws by state and, within the same state, orders opaque draws front to back.
+// Transparent draws flip the depth bits to get back to front
+
+enum class RenderPass : std::uint64_t
+{
+	Opaque = 0,
+	Transparent = 1,
+};
+
+constexpr int maxDrawTextures{ 2 };
+
+struct DrawCall
+{
+	const Shader* shader{ nullptr };
+	GLuint vao{ 0 };
+	// bound to units 0 and up, 0 leaves the unit as it is
+	GLuint textures[maxDrawTextures]{};
+	// all of them are bound to this target
+	GLenum textureTarget{ GL_TEXTURE_2D };
+
+	GLsizei indexCount{ 0 };
+	GLenum indexType{ GL_UNSIGNED_SHORT };
+	GLsizei instanceCount{ 1 };
+
+	// per draw uniforms, only set when the handle is valid
+	UniformHandle<glm::mat4> model;
+	glm::mat4 modelValue{ 1.0f };
+	UniformHandle<glm::vec3> color;
+	glm::vec3 colorValue{ 0.0f };
+
+	// GpuTimer pass the draw is timed under, -1 for none
+	int gpuPass{ -1 };
+};
+
+// How much state changed while executing the queue last frame
+struct RenderQueueStats
+{
+	unsigned int draws{ 0 };
+	unsigned int programChanges{ 0 };
+	unsigned int textureChanges{ 0 };
+	unsigned int vaoChanges{ 0 };
+};
+
+class RenderQueue
+{
+public:
+	RenderQueueStats stats;
+
+	void clear()
+	{
+		draws.clear();
+		keys.clear();
+	}
+
+	// viewDepth is the distance along the view direction, 0 at the camera and farPlane at the far plane
+	void submit(const DrawCall& draw, float viewDepth, float farPlane, RenderPass pass = RenderPass::Opaque)
+	{
+		std::uint64_t depth{ static_cast<std::uint64_t>(std::min(std::max(viewDepth / farPlane, 0.0f), 1.0f) * 0xFFFFFF) };
+		if (pass == RenderPass::Transparent)
+			depth = 0xFFFFFF - depth;
+
+		std::uint64_t key{ static_cast<std::uint64_t>(pass) << 62 };
+		key |= static_cast<std::uint64_t>(denseID(programs, draw.shader->ID, 0xFF)) << 54;
+		key |= static_cast<std::uint64_t>(textureSetID(draw)) << 44;
+		key |= static_cast<std::uint64_t>(denseID(vaos, draw.vao, 0xFF)) << 36;
+		key |= depth << 12;
+		key |= draws.size() & 0xFFF;
+
+		keys.push_back({ key, static_cast<std::uint32_t>(draws.size()) });
+		draws.push_back(draw);
+	}
+
+	// LSD radix sort over 8 bit digits, digits every key shares are skipped
+	void sort()
+	{
+		PROFILE_ZONE("render queue sort");
+		scratch.resize(keys.size());
+
+		for (int shift{ 0 }; shift < 64; shift += 8)
+		{
+			size_t counts[256]{};
+			for (const SortKey& key : keys)
+				counts[(key.key >> shift) & 0xFF]++;
+
+			if (!keys.empty() && counts[(keys[0].key >> shift) & 0xFF] == keys.size())
+				continue;
+
+			size_t offsets[256];
+			size_t total{ 0 };
+			for (int digit{ 0 }; digit < 256; digit++)
+			{
+				offsets[digit] = total;
+				total += counts[digit];
+			}
+
+			for (const SortKey& key : keys)
+				scratch[offsets[(key.key >> shift) & 0xFF]++] = key;
+			keys.swap(scratch);
+		}
+	}
+
+	// Issues every draw in key order, binding only what differs from the previous draw
+	// With a timer every run of draws with the same gpuPass is timed as one range
+	void execute(GpuTimer* timer = nullptr)
+	{
+		stats = {};
+
+		int currentPass{ -1 };
+		const Shader* currentShader{ nullptr };
+		GLuint currentVAO{ 0 };
+		GLuint currentTextures[maxDrawTextures]{};
+
+		for (const SortKey& key : keys)
+		{
+			const DrawCall& draw{ draws[key.draw] };
+
+			if (timer && draw.gpuPass != currentPass)
+			{
+				if (draw.gpuPass >= 0)
+					timer->begin(draw.gpuPass);
+				else
+					timer->end();
+				currentPass = draw.gpuPass;
+			}
+
+			if (draw.shader != currentShader)
+			{
+				draw.shader->use();
+				currentShader = draw.shader;
+				stats.programChanges++;
+			}
+
+			for (int unit{ 0 }; unit < maxDrawTextures; unit++)
+			{
+				if (draw.textures[unit] != 0 && draw.textures[unit] != currentTextures[unit])
+				{
+					glState.bindTexture(unit, draw.textureTarget, draw.textures[unit]);
+					currentTextures[unit] = draw.textures[unit];
+					stats.textureChanges++;
+				}
+			}
+
+			if (draw.vao != currentVAO)
+			{
+				glState.bindVertexArray(draw.vao);
+				currentVAO = draw.vao;
+				stats.vaoChanges++;
+			}
+
+			if (draw.model.valid())
+				draw.model.set(draw.modelValue);
+			if (draw.color.valid())
+				draw.color.set(draw.colorValue);
+
+			glDrawElementsInstanced(GL_TRIANGLES, draw.indexCount, draw.indexType, nullptr, draw.instanceCount);
+			stats.draws++;
+		}
+
+		if (timer)
+			timer->end();
+	}
+
+private:
+	struct SortKey
+	{
+		std::uint64_t key;
+		std::uint32_t draw;
+	};
+
+	std::vector<DrawCall> draws;
+	std::vector<SortKey> keys;
+	std::vector<SortKey> scratch;
+
+	// small ids for the key, handed out in order of first use and kept across frames
+	std::vector<GLuint> programs;
+	std::vector<GLuint> vaos;
+	std::vector<std::uint64_t> textureSets;
+
+	template <typename T>
+	static std::uint32_t denseID(std::vector<T>& known, T value, std::uint32_t limit)
+	{
+		auto found{ std::find(known.begin(), known.end(), value) };
+		if (found != known.end())
+			return static_cast<std::uint32_t>(found - known.begin()) & limit;
+
+		known.push_back(value);
+		return static_cast<std::uint32_t>(known.size() - 1) & limit;
+	}
+
+	std::uint32_t textureSetID(const DrawCall& draw)
+	{
+		std::uint64_t set{ static_cast<std::uint64_t>(draw.textures[0]) | static_cast<std::uint64_t>(draw.textures[1]) << 32 };
+		return denseID(textureSets, set, 0x3FF);
+	}
+};
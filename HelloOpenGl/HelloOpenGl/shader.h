@@ -2,22 +2,199 @@
 
 #include <glad/glad.h> // Need this to get all required opengl headers
 #include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
 
+#include <cstdint>
+#include <cstring>
 #include <string>
+#include <string_view>
+#include <vector>
 #include <fstream>
 #include <sstream>
 #include <iostream>
 #include <filesystem>
 
+#include "gl_state.h"
+#include "uniform_buffer.h"
+
 
 
 bool programStatus(GLuint program);
 bool shaderStatus(GLuint shader, std::string_view shader_type);
 
+// FNV-1a, used to hash uniform names
+// Only a constexpr UniformName is sure to be hashed at compile time, a literal passed straight
+// to a setter is hashed whenever the optimizer doesn't fold it
+constexpr std::uint32_t hashName(std::string_view name)
+{
+	std::uint32_t hash{ 2166136261u };
+	for (char c : name)
+	{
+		hash ^= static_cast<std::uint8_t>(c);
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+// Uniform name together with its hash, what every setter takes instead of a std::string
+// Only views the characters, so it never allocates. Declare the names used on every run as
+// constexpr UniformName constants, like Source.cpp does
+struct UniformName
+{
+	std::string_view name;
+	std::uint32_t hash;
+
+	constexpr UniformName(std::string_view n) : name(n), hash(hashName(n)) {}
+	constexpr UniformName(const char* n) : UniformName(std::string_view(n)) {}
+	UniformName(const std::string& n) : UniformName(std::string_view(n)) {}
+};
+
+// Flat open addressing hash table of uniform name -> location
+// Filled once from glGetActiveUniform after the program links, so lookups never call into the driver
+class UniformTable
+{
+public:
+	void build(GLuint program)
+	{
+		entries.clear();
+		count = 0;
+		highestLocation = -1;
+
+		GLint activeUniforms{ 0 };
+		GLint maxNameLength{ 0 };
+		glGetProgramiv(program, GL_ACTIVE_UNIFORMS, &activeUniforms);
+		glGetProgramiv(program, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+
+		// arrays of basic types report only "name[0]", so every element gets its own entry
+		std::vector<std::string> names;
+		std::vector<GLint> locations;
+		std::vector<char> buffer(static_cast<size_t>(maxNameLength) + 1);
+		for (GLint i{ 0 }; i < activeUniforms; i++)
+		{
+			GLsizei length{ 0 };
+			GLint size{ 0 };
+			GLenum type{ 0 };
+			glGetActiveUniform(program, static_cast<GLuint>(i), static_cast<GLsizei>(buffer.size()), &length, &size, &type, buffer.data());
+			std::string name(buffer.data(), static_cast<size_t>(length));
+
+			// uniforms inside blocks have no location
+			GLint location{ glGetUniformLocation(program, name.c_str()) };
+			if (location < 0)
+				continue;
+
+			// also one element arrays, glGetUniformLocation finds those by their base name too
+			if (name.size() > 3 && name.compare(name.size() - 3, 3, "[0]") == 0)
+			{
+				std::string base{ name.substr(0, name.size() - 3) };
+				names.push_back(base);
+				locations.push_back(location);
+				for (GLint element{ 0 }; element < size; element++)
+				{
+					std::string elementName{ base + '[' + std::to_string(element) + ']' };
+					names.push_back(elementName);
+					locations.push_back(glGetUniformLocation(program, elementName.c_str()));
+				}
+			}
+			else
+			{
+				names.push_back(name);
+				locations.push_back(location);
+			}
+		}
+
+		// keep the load factor at or below one half
+		size_t capacity{ 16 };
+		while (capacity < names.size() * 2)
+			capacity *= 2;
+		entries.resize(capacity);
+
+		for (size_t i{ 0 }; i < names.size(); i++)
+			insert(names[i], locations[i]);
+	}
+
+	// Returns -1 for unknown names, same as glGetUniformLocation
+	GLint find(UniformName uniform) const
+	{
+		if (entries.empty())
+			return -1;
+
+		std::string_view name{ uniform.name };
+		std::uint32_t hash{ uniform.hash };
+		size_t mask{ entries.size() - 1 };
+		for (size_t slot{ hash & mask };; slot = (slot + 1) & mask)
+		{
+			const Entry& entry{ entries[slot] };
+			if (entry.location == empty)
+				return -1;
+			if (entry.hash == hash && entry.name == name)
+				return entry.location;
+		}
+	}
+
+	size_t size() const { return count; }
+	GLint maxLocation() const { return highestLocation; }
+
+	template <typename Func>
+	void forEach(Func func) const
+	{
+		for (const Entry& entry : entries)
+		{
+			if (entry.location != empty)
+				func(entry.name, entry.location);
+		}
+	}
+
+private:
+	static constexpr GLint empty{ -2 };
+
+	struct Entry
+	{
+		std::uint32_t hash{ 0 };
+		GLint location{ empty };
+		std::string name;
+	};
+
+	std::vector<Entry> entries;
+	size_t count{ 0 };
+	GLint highestLocation{ -1 };
+
+	void insert(const std::string& name, GLint location)
+	{
+		std::uint32_t hash{ hashName(name) };
+		size_t mask{ entries.size() - 1 };
+		size_t slot{ hash & mask };
+		while (entries[slot].location != empty)
+		{
+			if (entries[slot].hash == hash && entries[slot].name == name)
+				return;
+			slot = (slot + 1) & mask;
+		}
+		entries[slot] = Entry{ hash, location, name };
+		count++;
+		if (location > highestLocation)
+			highestLocation = location;
+	}
+};
+
+// Uploads a value of any uniform type we use to a location of the currently bound program
+inline void setUniform(GLint location, bool value) { glUniform1i(location, static_cast<int>(value)); }
+inline void setUniform(GLint location, int value) { glUniform1i(location, value); }
+inline void setUniform(GLint location, float value) { glUniform1f(location, value); }
+inline void setUniform(GLint location, const glm::vec3& value) { glUniform3f(location, value.x, value.y, value.z); }
+inline void setUniform(GLint location, const glm::mat4& value) { glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value)); }
+
+// Last value uploaded to one uniform location, big enough for a mat4
+struct UniformShadow
+{
+	alignas(16) unsigned char bytes[sizeof(glm::mat4)];
+	bool valid{ false };
+};
+
 class Shader
 {
 public:
 	GLuint ID;
+	UniformTable uniforms;
 
 	Shader(const char* vertexPath, const char* fragmentPath)
 	{
@@ -48,8 +225,8 @@ public:
 		}
 		catch (std::ifstream::failure e)
 		{
-			std::cout << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
-			std::cout << "Current path: " << std::filesystem::current_path() << '\n';
+			std::cerr << "ERROR::SHADER::FILE_NOT_SUCCESFULLY_READ" << std::endl;
+			std::cerr << "Current path: " << std::filesystem::current_path() << '\n';
 		}
 		const char* vShaderCode = vertexCode.c_str();
 		const char* fShaderCode = fragmentCode.c_str();
@@ -77,6 +254,11 @@ public:
 		glLinkProgram(ID);
 		programStatus(ID);
 
+		// look up every active uniform once, setters only read from this table afterwards
+		uniforms.build(ID);
+		bindSharedBlocks(ID);
+		shadow.resize(static_cast<size_t>(uniforms.maxLocation() + 1));
+
 		// delete the shaders as they're linked into our program now and no longer necessary
 		glDeleteShader(vertex);
 		glDeleteShader(fragment);
@@ -84,38 +266,119 @@ public:
 
 	void use() const
 	{
-		glUseProgram(ID);
+		glState.useProgram(ID);
+	}
+
+	GLint location(UniformName name) const
+	{
+		return uniforms.find(name);
 	}
 
-	void setBool(std::string name, bool value) const
+	void setBool(UniformName name, bool value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), static_cast<int>(value));
+		setBool(location(name), value);
 	}
-	void setInt(std::string name, int value) const
+	void setInt(UniformName name, int value) const
 	{
-		glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+		setInt(location(name), value);
 	}
-	void setFloat(std::string name, float value) const
+	void setFloat(UniformName name, float value) const
 	{
-		glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+		setFloat(location(name), value);
 	}
-	void setMat4(std::string name, glm::mat4 value) const
+	void setMat4(UniformName name, const glm::mat4& value) const
 	{
-		glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, glm::value_ptr(value));
+		setMat4(location(name), value);
 	}
 
-	void setVec3(std::string name, float x, float y, float z) const
+	void setVec3(UniformName name, float x, float y, float z) const
+	{
+		setVec3(location(name), x, y, z);
+	}
+	void setVec3(UniformName name, float x) const
+	{
+		setVec3(location(name), x, x, x);
+	}
+	void setVec3(UniformName name, glm::vec3 v) const
+	{
+		setVec3(location(name), v.x, v.y, v.z);
+	}
+
+	// Same setters for a location that was already looked up
+	void setBool(GLint location, bool value) const
+	{
+		set(location, value);
+	}
+	void setInt(GLint location, int value) const
+	{
+		set(location, value);
+	}
+	void setFloat(GLint location, float value) const
+	{
+		set(location, value);
+	}
+	void setMat4(GLint location, const glm::mat4& value) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z);
+		set(location, value);
 	}
-	void setVec3(std::string name, float x) const
+	void setVec3(GLint location, float x, float y, float z) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), x, x, x);
+		set(location, glm::vec3(x, y, z));
 	}
-	void setVec3(std::string name, glm::vec3 v) const
+	void setVec3(GLint location, glm::vec3 v) const
+	{
+		set(location, v);
+	}
+
+	// Every setter ends up here, the upload is skipped when the value is already what the program holds
+	template <typename T>
+	void set(GLint location, const T& value) const
 	{
-		glUniform3f(glGetUniformLocation(ID, name.c_str()), v.x, v.y, v.z);
+		static_assert(sizeof(T) <= sizeof(UniformShadow::bytes), "uniform type too big for its shadow copy");
+
+		if (location < 0)
+			return;
+
+		if (static_cast<size_t>(location) < shadow.size())
+		{
+			UniformShadow& cached{ shadow[location] };
+			if (cached.valid && std::memcmp(cached.bytes, &value, sizeof(T)) == 0)
+			{
+				uniformStats.elided++;
+				return;
+			}
+			std::memcpy(cached.bytes, &value, sizeof(T));
+			cached.valid = true;
+		}
+
+		uniformStats.issued++;
+		setUniform(location, value);
 	}
+
+private:
+	// indexed by location, uniform values belong to the program so this stays valid across use() calls
+	mutable std::vector<UniformShadow> shadow;
+};
+
+// Typed uniform that resolves its name once and afterwards only holds the location
+// set() does no lookup and no allocation, the shader still has to be bound with use()
+// and must outlive the handle
+template <typename T>
+class UniformHandle
+{
+public:
+	const Shader* shader{ nullptr };
+	GLint location{ -1 };
+
+	UniformHandle() = default;
+	UniformHandle(const Shader& shader, UniformName name) : shader(&shader), location(shader.location(name)) {}
+
+	void set(const T& value) const
+	{
+		shader->set(location, value);
+	}
+
+	bool valid() const { return location >= 0; }
 };
 
 
@@ -129,10 +392,10 @@ bool programStatus(GLuint program)
 	glGetProgramiv(program, GL_LINK_STATUS, &success);
 	if (!success) {
 		glGetProgramInfoLog(program, 512, NULL, infoLog);
-		std::cout << " Shader Program failed to compile\n" << infoLog << '\n';
+		std::cerr << " Shader Program failed to compile\n" << infoLog << '\n';
 		return false;
 	}
-	std::cout << "Shader Program working\n";
+	std::cerr << "Shader Program working\n";
 	return true;
 }
 
@@ -145,10 +408,10 @@ bool shaderStatus(GLuint shader, std::string_view shader_type)
 	if (!success)
 	{
 		glGetShaderInfoLog(shader, 512, nullptr, infoLog);
-		std::cout << shader_type << " failed to compile\n" << infoLog << '\n';
+		std::cerr << shader_type << " failed to compile\n" << infoLog << '\n';
 		return false;
 	}
-	std::cout << shader_type << " working\n";
+	std::cerr << shader_type << " working\n";
 	return true;
 }
 
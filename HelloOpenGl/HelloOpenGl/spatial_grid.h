@@ -0,0 +1,351 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+#include "bounds.h"
+#include "frustum.h"
+
+// Loose hashed grid for objects that move every frame
+// Every object lives in the one cell its center is in, only cells that hold something exist
+// (a hash map from cell coordinates), so the world has no fixed size. Moving an object costs
+// nothing until its center crosses into another cell, then it's a swap remove and a push.
+// Objects stick out of their cell by up to half their size, so every cell is treated as
+// "loose": its box grows by the largest extent seen so far when it's queried.
+// Same queries as Bvh, the BVH is better for things that stay put, this one doesn't care how
+// much or how often things move
+// Objects are referred to by index, the same one they have in the bounds passed to the queries
+
+class SpatialGrid
+{
+public:
+	explicit SpatialGrid(float cellSize = 8.0f) : cellSize{ cellSize }, inverseCellSize{ 1.0f / cellSize }
+	{
+	}
+
+	void clear()
+	{
+		cells.clear();
+		cellLookup.clear();
+		objects.clear();
+		maxExtent = 0.0f;
+		occupied = Aabb{};
+		moves = 0;
+	}
+
+	// Starts over with every box in bounds
+	void build(const std::vector<Aabb>& bounds)
+	{
+		clear();
+		objects.reserve(bounds.size());
+		for (size_t i{ 0 }; i < bounds.size(); i++)
+			update(static_cast<std::uint32_t>(i), bounds[i]);
+	}
+
+	// Adds object or tells the grid where it is now, only touches the cells when it changed cell
+	void update(std::uint32_t object, const Aabb& box)
+	{
+		if (object >= objects.size())
+			objects.resize(object + 1);
+
+		glm::vec3 extents{ box.extents() };
+		maxExtent = std::max(maxExtent, std::max(extents.x, std::max(extents.y, extents.z)));
+
+		glm::ivec3 coordinate{ cellOf(box.center()) };
+		ObjectSlot& slot{ objects[object] };
+		if (slot.cell != none && slot.coordinate == coordinate)
+			return;
+
+		if (slot.cell != none)
+		{
+			detach(object);
+			moves++;
+		}
+		attach(object, coordinate);
+	}
+
+	void remove(std::uint32_t object)
+	{
+		if (object < objects.size() && objects[object].cell != none)
+			detach(object);
+	}
+
+	// Appends every object whose box intersects the frustum to out
+	// Only looks at the cells under the frustum's box (it ends at the far plane), so the cost follows what's in view
+	void queryFrustum(const Frustum& frustum, const std::vector<Aabb>& bounds, std::vector<std::uint32_t>& out) const
+	{
+		if (cells.empty())
+			return;
+
+		auto test = [&](const Cell& cell) {
+			int overlap{ frustumOverlap(frustum, looseBounds(cell.coordinate), allFrustumPlanes) };
+			if (overlap < 0)
+				return;
+			if (overlap == 0)
+			{
+				out.insert(out.end(), cell.objects.begin(), cell.objects.end());
+				return;
+			}
+			for (std::uint32_t object : cell.objects)
+			{
+				if (frustumOverlap(frustum, bounds[object], overlap) >= 0)
+					out.push_back(object);
+			}
+		};
+
+		// objects stick out of their cells by up to maxExtent, and there's nothing outside the occupied cells
+		Aabb view{ frustumBounds(frustum) };
+		glm::vec3 min{ glm::max(view.min - glm::vec3(maxExtent), occupied.min) };
+		glm::vec3 max{ glm::min(view.max + glm::vec3(maxExtent), occupied.max) };
+		if (glm::any(glm::greaterThan(min, max)))
+			return;
+		glm::ivec3 low{ cellOf(min) };
+		glm::ivec3 high{ cellOf(max) };
+		glm::ivec3 size{ high - low + glm::ivec3(1) };
+
+		// a frustum over a sparse world covers more cells than exist, then it's cheaper to go over the ones that do
+		if (static_cast<double>(size.x) * size.y * size.z > static_cast<double>(cells.size()))
+		{
+			for (const Cell& cell : cells)
+				test(cell);
+			return;
+		}
+		for (int z{ low.z }; z <= high.z; z++)
+		{
+			for (int y{ low.y }; y <= high.y; y++)
+			{
+				for (int x{ low.x }; x <= high.x; x++)
+				{
+					if (const Cell* cell{ find(glm::ivec3(x, y, z)) })
+						test(*cell);
+				}
+			}
+		}
+	}
+
+	// Nearest object box the ray hits, direction doesn't have to be normalized but distances are in its units
+	// Walks the cells along the ray (3D DDA) and tests the objects of each one's neighbours too,
+	// since that's where objects that stick out into it live. Stops at the first cell that starts
+	// further away than the best hit
+	RayHit raycast(glm::vec3 origin, glm::vec3 direction, const std::vector<Aabb>& bounds, float maxDistance = std::numeric_limits<float>::max()) const
+	{
+		RayHit best;
+		best.distance = maxDistance;
+		if (cells.empty())
+			return best;
+
+		glm::vec3 inverse{ 1.0f / direction };
+		constexpr float miss{ std::numeric_limits<float>::max() };
+
+		// nothing outside the occupied cells, so the walk starts and ends there
+		Aabb reach{ occupied.min - glm::vec3(maxExtent), occupied.max + glm::vec3(maxExtent) };
+		float t{ rayBoxDistance(reach, origin, inverse, maxDistance) };
+		if (t == miss)
+			return best;
+		float exit{ exitDistance(reach, origin, inverse) };
+
+		glm::vec3 start{ origin + direction * t };
+		glm::ivec3 cell{ cellOf(start) };
+		glm::ivec3 step{ glm::sign(direction) };
+		// distance to the next cell boundary on every axis, and between boundaries
+		glm::vec3 next;
+		glm::vec3 delta;
+		for (int axis{ 0 }; axis < 3; axis++)
+		{
+			float d{ direction[axis] };
+			if (d == 0.0f)
+			{
+				next[axis] = miss;
+				delta[axis] = miss;
+				continue;
+			}
+			float boundary{ (cell[axis] + (d > 0.0f ? 1 : 0)) * cellSize };
+			next[axis] = t + (boundary - start[axis]) / d;
+			delta[axis] = cellSize / std::abs(d);
+		}
+
+		// how many cells around the walked one objects can reach in from
+		int ring{ static_cast<int>(std::ceil(maxExtent * inverseCellSize)) };
+		while (t <= best.distance && t <= exit)
+		{
+			for (int z{ -ring }; z <= ring; z++)
+			{
+				for (int y{ -ring }; y <= ring; y++)
+				{
+					for (int x{ -ring }; x <= ring; x++)
+					{
+						const Cell* neighbour{ find(cell + glm::ivec3(x, y, z)) };
+						if (!neighbour)
+							continue;
+						for (std::uint32_t object : neighbour->objects)
+						{
+							float distance{ rayBoxDistance(bounds[object], origin, inverse, best.distance) };
+							if (distance != miss && distance < best.distance)
+								best = { object, distance };
+						}
+					}
+				}
+			}
+
+			int axis{ next.x < next.y ? (next.x < next.z ? 0 : 2) : (next.y < next.z ? 1 : 2) };
+			t = next[axis];
+			next[axis] += delta[axis];
+			cell[axis] += step[axis];
+		}
+		return best;
+	}
+
+	// Appends every object whose box is within radius of center
+	void querySphere(glm::vec3 center, float radius, const std::vector<Aabb>& bounds, std::vector<std::uint32_t>& out) const
+	{
+		float reach{ radius + maxExtent };
+		glm::ivec3 low{ cellOf(center - glm::vec3(reach)) };
+		glm::ivec3 high{ cellOf(center + glm::vec3(reach)) };
+		glm::ivec3 size{ high - low + glm::ivec3(1) };
+
+		auto test = [&](const Cell& cell) {
+			if (!sphereOverlapsBox(center, radius, looseBounds(cell.coordinate)))
+				return;
+			for (std::uint32_t object : cell.objects)
+			{
+				if (sphereOverlapsBox(center, radius, bounds[object]))
+					out.push_back(object);
+			}
+		};
+
+		// a big sphere covers more cells than exist, then it's cheaper to go over the ones that do
+		if (static_cast<double>(size.x) * size.y * size.z > static_cast<double>(cells.size()))
+		{
+			for (const Cell& cell : cells)
+				test(cell);
+			return;
+		}
+		for (int z{ low.z }; z <= high.z; z++)
+		{
+			for (int y{ low.y }; y <= high.y; y++)
+			{
+				for (int x{ low.x }; x <= high.x; x++)
+				{
+					if (const Cell* cell{ find(glm::ivec3(x, y, z)) })
+						test(*cell);
+				}
+			}
+		}
+	}
+
+	size_t cellCount() const { return cells.size(); }
+	// objects that changed cell since the grid was built
+	size_t cellChanges() const { return moves; }
+
+private:
+	static constexpr std::uint32_t none{ std::numeric_limits<std::uint32_t>::max() };
+
+	struct Cell
+	{
+		glm::ivec3 coordinate;
+		std::vector<std::uint32_t> objects;
+	};
+
+	struct ObjectSlot
+	{
+		glm::ivec3 coordinate{ 0 };
+		std::uint32_t cell{ none };
+		// position in the cell's objects
+		std::uint32_t slot{ 0 };
+	};
+
+	float cellSize;
+	float inverseCellSize;
+	// largest half size of any object so far, how far the cells are loosened
+	float maxExtent{ 0.0f };
+	// union of the cells that ever held something
+	Aabb occupied;
+	size_t moves{ 0 };
+
+	// only occupied cells, removing one moves the last one into its place
+	std::vector<Cell> cells;
+	std::unordered_map<std::uint64_t, std::uint32_t> cellLookup;
+	std::vector<ObjectSlot> objects;
+
+	glm::ivec3 cellOf(glm::vec3 position) const
+	{
+		return glm::ivec3(glm::floor(position * inverseCellSize));
+	}
+
+	// 21 bits per axis, a million cells in every direction
+	static std::uint64_t key(glm::ivec3 coordinate)
+	{
+		constexpr std::uint64_t mask{ (1u << 21) - 1 };
+		return (static_cast<std::uint64_t>(coordinate.x) & mask) | ((static_cast<std::uint64_t>(coordinate.y) & mask) << 21)
+			| ((static_cast<std::uint64_t>(coordinate.z) & mask) << 42);
+	}
+
+	const Cell* find(glm::ivec3 coordinate) const
+	{
+		auto found{ cellLookup.find(key(coordinate)) };
+		return found == cellLookup.end() ? nullptr : &cells[found->second];
+	}
+
+	Aabb looseBounds(glm::ivec3 coordinate) const
+	{
+		glm::vec3 min{ glm::vec3(coordinate) * cellSize };
+		return { min - glm::vec3(maxExtent), min + glm::vec3(cellSize + maxExtent) };
+	}
+
+	// Where the ray leaves box, box has to be one it enters
+	static float exitDistance(const Aabb& box, glm::vec3 origin, glm::vec3 inverseDirection)
+	{
+		glm::vec3 further{ glm::max((box.min - origin) * inverseDirection, (box.max - origin) * inverseDirection) };
+		return std::min(further.x, std::min(further.y, further.z));
+	}
+
+	void attach(std::uint32_t object, glm::ivec3 coordinate)
+	{
+		auto [found, added] = cellLookup.try_emplace(key(coordinate), static_cast<std::uint32_t>(cells.size()));
+		if (added)
+		{
+			cells.push_back({ coordinate, {} });
+			glm::vec3 min{ glm::vec3(coordinate) * cellSize };
+			occupied.grow(min);
+			occupied.grow(min + glm::vec3(cellSize));
+		}
+
+		Cell& cell{ cells[found->second] };
+		objects[object] = { coordinate, found->second, static_cast<std::uint32_t>(cell.objects.size()) };
+		cell.objects.push_back(object);
+	}
+
+	void detach(std::uint32_t object)
+	{
+		ObjectSlot& slot{ objects[object] };
+		Cell& cell{ cells[slot.cell] };
+
+		// the last object takes this one's place
+		std::uint32_t last{ cell.objects.back() };
+		cell.objects[slot.slot] = last;
+		objects[last].slot = slot.slot;
+		cell.objects.pop_back();
+
+		if (cell.objects.empty())
+		{
+			// same for the cells
+			std::uint32_t emptied{ slot.cell };
+			cellLookup.erase(key(cell.coordinate));
+			if (emptied != cells.size() - 1)
+			{
+				cells[emptied] = std::move(cells.back());
+				cellLookup[key(cells[emptied].coordinate)] = emptied;
+				for (std::uint32_t moved : cells[emptied].objects)
+					objects[moved].cell = emptied;
+			}
+			cells.pop_back();
+		}
+		slot.cell = none;
+	}
+};
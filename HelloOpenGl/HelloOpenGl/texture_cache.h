@@ -0,0 +1,240 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include "gl_state.h"
+#include "mip_generator.h"
+#include "texture_file.h"
+#include "texture_loader.h"
+
+// Every texture the app uses comes through here
+// Textures are keyed by canonical path + load options, so asking for the same file twice
+// (also while the first load is still on a worker) hands out the texture that's already there.
+// Handles are ref counted. A texture nobody holds stays resident until the budget runs out,
+// then the least recently used ones are deleted first. A texture is in use from acquire() until its
+// last handle goes away, so one held for the whole run counts as used right up to its release
+// A file that fails to load keeps its placeholder and stays in the cache, so it isn't read again
+// GL thread only
+
+// 256 MB of texture memory
+constexpr size_t defaultTextureBudget{ 256u << 20 };
+
+// Counted since the cache was made
+struct TextureCacheStats
+{
+	unsigned int hits{ 0 };
+	unsigned int misses{ 0 };
+	unsigned int evictions{ 0 };
+	size_t residentBytes{ 0 };
+	size_t textures{ 0 };
+};
+
+class TextureCache;
+
+struct TextureEntry
+{
+	TextureCache* cache{ nullptr };
+	std::string key;
+	GLuint texture{ 0 };
+	// 0 until the loader has uploaded it
+	size_t bytes{ 0 };
+	bool loaded{ false };
+	// the loader couldn't read the file, the placeholder is all it will ever have
+	bool failed{ false };
+};
+
+// Keeps its texture from being evicted for as long as any copy of it exists
+// The cache has to outlive its handles
+class TextureHandle
+{
+public:
+	TextureHandle() = default;
+	explicit TextureHandle(std::shared_ptr<TextureEntry> entry) : entry{ std::move(entry) }
+	{
+	}
+
+	TextureHandle(const TextureHandle&) = default;
+	TextureHandle(TextureHandle&&) noexcept = default;
+
+	TextureHandle& operator=(TextureHandle other)
+	{
+		release();
+		entry = std::move(other.entry);
+		return *this;
+	}
+
+	~TextureHandle()
+	{
+		release();
+	}
+
+	GLuint id() const { return entry ? entry->texture : 0; }
+	bool loaded() const { return entry && entry->loaded; }
+	bool failed() const { return entry && entry->failed; }
+	explicit operator bool() const { return entry != nullptr; }
+
+private:
+	std::shared_ptr<TextureEntry> entry;
+
+	void release();
+};
+
+class TextureCache
+{
+public:
+	TextureCache(TextureLoader& loader, size_t budget = defaultTextureBudget) : loader{ loader }, budget{ budget }
+	{
+		loader.onUpload = [this](GLuint texture, size_t bytes) { uploaded(texture, bytes); };
+		loader.onFailure = [this](GLuint texture) { failed(texture); };
+	}
+
+	// The compressed .htex next to path is used when there is one, like preferTextureFile
+	TextureHandle acquire(const std::string& path, glm::vec4 placeholder, TextureColorSpace colorSpace = TextureColorSpace::SRGB)
+	{
+		// a name that was asked for before skips the disk, the .htex check and canonical path are only done on a miss
+		std::string request{ path + colorSpaceSuffix(colorSpace) };
+		auto known{ resolved.find(request) };
+		if (known != resolved.end())
+			if (TextureHandle handle{ hit(known->second) })
+				return handle;
+
+		std::string file{ preferTextureFile(path) };
+		std::string key{ cacheKey(file, colorSpace) };
+		resolved[request] = key;
+		if (TextureHandle handle{ hit(key) })
+			return handle;
+
+		stats.misses++;
+		auto entry{ std::make_shared<TextureEntry>() };
+		entry->cache = this;
+		entry->key = key;
+		entry->texture = loader.load(file, placeholder, colorSpace);
+		recent.push_front(entry);
+		entries[key] = recent.begin();
+		byTexture[entry->texture] = entry.get();
+		stats.textures = entries.size();
+		return TextureHandle{ entry };
+	}
+
+	// Uploads what the workers finished and evicts down to the budget, once per frame
+	void update()
+	{
+		loader.update();
+		trim();
+	}
+
+	// Deletes unreferenced textures, least recently used first, until the resident ones fit the budget
+	void trim()
+	{
+		for (auto it{ recent.end() }; it != recent.begin() && stats.residentBytes > budget;)
+		{
+			--it;
+			const std::shared_ptr<TextureEntry>& entry{ *it };
+			// held by a handle, or the loader still has to upload into it
+			// failed ones are kept too, they're only a texel and dropping them would load the file again
+			if (entry.use_count() > 1 || !entry->loaded)
+				continue;
+
+			GLuint texture{ entry->texture };
+			glDeleteTextures(1, &texture);
+			glState.forgetTexture(texture);
+			stats.residentBytes -= entry->bytes;
+			stats.evictions++;
+
+			byTexture.erase(texture);
+			entries.erase(entry->key);
+			it = recent.erase(it);
+		}
+		stats.textures = entries.size();
+	}
+
+	void setBudget(size_t bytes)
+	{
+		budget = bytes;
+		trim();
+	}
+
+	const TextureCacheStats& statistics() const { return stats; }
+
+private:
+	friend class TextureHandle;
+
+	TextureLoader& loader;
+	size_t budget;
+	TextureCacheStats stats;
+
+	// most recently used first, this is the cache's one reference to every entry
+	std::list<std::shared_ptr<TextureEntry>> recent;
+	std::unordered_map<std::string, std::list<std::shared_ptr<TextureEntry>>::iterator> entries;
+	std::unordered_map<GLuint, TextureEntry*> byTexture;
+	// path + colour space as acquire() was given them, to the key they resolved to
+	std::unordered_map<std::string, std::string> resolved;
+
+	static const char* colorSpaceSuffix(TextureColorSpace colorSpace)
+	{
+		return colorSpace == TextureColorSpace::SRGB ? "|srgb" : "|linear";
+	}
+
+	// "../x.png" and "x.png" from the same directory are one texture, and so is a file asked for twice
+	// with the same options. The colour space changes the mips, so it's part of the key
+	static std::string cacheKey(const std::string& path, TextureColorSpace colorSpace)
+	{
+		std::error_code error;
+		std::filesystem::path canonical{ std::filesystem::weakly_canonical(path, error) };
+		std::string key{ error ? path : canonical.string() };
+		key += colorSpaceSuffix(colorSpace);
+		return key;
+	}
+
+	void uploaded(GLuint texture, size_t bytes)
+	{
+		auto found{ byTexture.find(texture) };
+		if (found == byTexture.end())
+			return;
+		TextureEntry& entry{ *found->second };
+		stats.residentBytes = stats.residentBytes - entry.bytes + bytes;
+		entry.bytes = bytes;
+		entry.loaded = true;
+	}
+
+	void failed(GLuint texture)
+	{
+		auto found{ byTexture.find(texture) };
+		if (found != byTexture.end())
+			found->second->failed = true;
+	}
+
+	// The last handle of entry is going away, that's the last time it was used
+	void released(const TextureEntry& entry)
+	{
+		auto found{ entries.find(entry.key) };
+		if (found != entries.end())
+			recent.splice(recent.begin(), recent, found->second);
+	}
+
+	TextureHandle hit(const std::string& key)
+	{
+		auto found{ entries.find(key) };
+		if (found == entries.end())
+			return {};
+		stats.hits++;
+		// most recently used goes to the front
+		recent.splice(recent.begin(), recent, found->second);
+		return TextureHandle{ *found->second };
+	}
+};
+
+inline void TextureHandle::release()
+{
+	// the cache's reference and this one
+	if (entry && entry.use_count() == 2)
+		entry->cache->released(*entry);
+	entry.reset();
+}
@@ -0,0 +1,827 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// CPU block compressors for the offline --compress tool, no GL in here
+// Every format works on 4x4 pixel blocks of RGBA8, edge blocks repeat the last row/column
+//   BC1  8 bytes  RGB, endpoints along the principal axis + one least squares refinement
+//   BC3  16 bytes BC4 alpha block followed by a BC1 colour block
+//   BC4  8 bytes  one channel (red), 8 interpolated values between min and max
+//   BC5  16 bytes two BC4 blocks, red and green
+//   BC7  16 bytes mode 6 only: one RGBA line with 7 bit endpoints + p bits and 4 bit indices
+//   ETC2 8 bytes  RGB, the ETC1 compatible individual/differential modes only
+// Decoders for the same subsets are here too so the tool can report the error without a GPU
+
+enum class TextureFormat : std::uint32_t
+{
+	RGBA8 = 0,
+	BC1 = 1,
+	BC3 = 2,
+	BC4 = 3,
+	BC5 = 4,
+	BC7 = 5,
+	ETC2 = 6,
+};
+
+inline bool isCompressed(TextureFormat format)
+{
+	return format != TextureFormat::RGBA8;
+}
+
+// bytes per 4x4 block, or per pixel for RGBA8
+inline std::uint32_t blockBytes(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::RGBA8: return 4;
+	case TextureFormat::BC1:
+	case TextureFormat::BC4:
+	case TextureFormat::ETC2: return 8;
+	default: return 16;
+	}
+}
+
+inline size_t compressedSize(TextureFormat format, int width, int height)
+{
+	if (!isCompressed(format))
+		return static_cast<size_t>(width) * height * 4;
+	return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+}
+
+using PixelBlock = std::uint8_t[16][4];
+
+namespace compression
+{
+	inline int squaredError(const std::uint8_t* a, const int* b, int channels)
+	{
+		int error{ 0 };
+		for (int c{ 0 }; c < channels; c++)
+			error += (a[c] - b[c]) * (a[c] - b[c]);
+		return error;
+	}
+
+	// Principal axis of the block's first `channels` channels by power iteration, normalized
+	inline void principalAxis(const PixelBlock& block, int channels, float mean[4], float axis[4])
+	{
+		for (int c{ 0 }; c < 4; c++)
+			mean[c] = 0.0f;
+		for (int p{ 0 }; p < 16; p++)
+			for (int c{ 0 }; c < channels; c++)
+				mean[c] += block[p][c] / 16.0f;
+
+		float covariance[4][4]{};
+		for (int p{ 0 }; p < 16; p++)
+			for (int i{ 0 }; i < channels; i++)
+				for (int j{ 0 }; j < channels; j++)
+					covariance[i][j] += (block[p][i] - mean[i]) * (block[p][j] - mean[j]);
+
+		for (int c{ 0 }; c < 4; c++)
+			axis[c] = c < channels ? 1.0f : 0.0f;
+		for (int iteration{ 0 }; iteration < 8; iteration++)
+		{
+			float next[4]{};
+			for (int i{ 0 }; i < channels; i++)
+				for (int j{ 0 }; j < channels; j++)
+					next[i] += covariance[i][j] * axis[j];
+
+			float length{ 0.0f };
+			for (int c{ 0 }; c < channels; c++)
+				length += next[c] * next[c];
+			if (length < 1e-12f)
+				break;
+			length = std::sqrt(length);
+			for (int c{ 0 }; c < channels; c++)
+				axis[c] = next[c] / length;
+		}
+	}
+
+	// Ends of the block's projection on the axis
+	inline void axisExtent(const PixelBlock& block, int channels, const float mean[4], const float axis[4], float low[4], float high[4])
+	{
+		float minimum{ 1e30f };
+		float maximum{ -1e30f };
+		for (int p{ 0 }; p < 16; p++)
+		{
+			float t{ 0.0f };
+			for (int c{ 0 }; c < channels; c++)
+				t += (block[p][c] - mean[c]) * axis[c];
+			minimum = std::min(minimum, t);
+			maximum = std::max(maximum, t);
+		}
+		for (int c{ 0 }; c < 4; c++)
+		{
+			low[c] = c < channels ? mean[c] + axis[c] * minimum : 0.0f;
+			high[c] = c < channels ? mean[c] + axis[c] * maximum : 0.0f;
+		}
+	}
+
+	// Endpoints that best fit pixels = (1 - weight) * a + weight * b for fixed weights, per channel
+	// Returns false if all weights are the same and there's nothing to solve
+	inline bool leastSquaresEndpoints(const PixelBlock& block, int channels, const float weights[16], float a[4], float b[4])
+	{
+		float aa{ 0.0f }, ab{ 0.0f }, bb{ 0.0f };
+		float ax[4]{}, bx[4]{};
+		for (int p{ 0 }; p < 16; p++)
+		{
+			float wb{ weights[p] };
+			float wa{ 1.0f - wb };
+			aa += wa * wa;
+			ab += wa * wb;
+			bb += wb * wb;
+			for (int c{ 0 }; c < channels; c++)
+			{
+				ax[c] += wa * block[p][c];
+				bx[c] += wb * block[p][c];
+			}
+		}
+
+		float determinant{ aa * bb - ab * ab };
+		if (std::fabs(determinant) < 1e-6f)
+			return false;
+		for (int c{ 0 }; c < channels; c++)
+		{
+			a[c] = std::min(std::max((ax[c] * bb - bx[c] * ab) / determinant, 0.0f), 255.0f);
+			b[c] = std::min(std::max((bx[c] * aa - ax[c] * ab) / determinant, 0.0f), 255.0f);
+		}
+		return true;
+	}
+
+	inline void putBits(std::uint8_t* out, int& position, std::uint32_t value, int count)
+	{
+		for (int i{ 0 }; i < count; i++, position++)
+		{
+			if (value >> i & 1)
+				out[position >> 3] |= static_cast<std::uint8_t>(1 << (position & 7));
+		}
+	}
+
+	inline std::uint32_t getBits(const std::uint8_t* in, int& position, int count)
+	{
+		std::uint32_t value{ 0 };
+		for (int i{ 0 }; i < count; i++, position++)
+			value |= static_cast<std::uint32_t>(in[position >> 3] >> (position & 7) & 1) << i;
+		return value;
+	}
+
+	// BC1
+	// ===
+
+	inline std::uint16_t pack565(const float color[4])
+	{
+		int r{ static_cast<int>(std::lround(color[0] * 31.0f / 255.0f)) };
+		int g{ static_cast<int>(std::lround(color[1] * 63.0f / 255.0f)) };
+		int b{ static_cast<int>(std::lround(color[2] * 31.0f / 255.0f)) };
+		return static_cast<std::uint16_t>(std::min(std::max(r, 0), 31) << 11 | std::min(std::max(g, 0), 63) << 5 | std::min(std::max(b, 0), 31));
+	}
+
+	inline void unpack565(std::uint16_t packed, int color[3])
+	{
+		int r{ packed >> 11 & 31 };
+		int g{ packed >> 5 & 63 };
+		int b{ packed & 31 };
+		color[0] = r << 3 | r >> 2;
+		color[1] = g << 2 | g >> 4;
+		color[2] = b << 3 | b >> 2;
+	}
+
+	// The four colours of a 4 colour mode block, index 2 and 3 sit a third of the way along
+	inline void bc1Palette(std::uint16_t c0, std::uint16_t c1, int palette[4][3])
+	{
+		unpack565(c0, palette[0]);
+		unpack565(c1, palette[1]);
+		for (int c{ 0 }; c < 3; c++)
+		{
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+	}
+
+	// Best index per pixel, returns the total squared error
+	inline int bc1Indices(const PixelBlock& block, std::uint16_t c0, std::uint16_t c1, std::uint32_t& indices)
+	{
+		int palette[4][3];
+		bc1Palette(c0, c1, palette);
+
+		int total{ 0 };
+		indices = 0;
+		for (int p{ 0 }; p < 16; p++)
+		{
+			int best{ 0 };
+			int bestError{ squaredError(block[p], palette[0], 3) };
+			for (int i{ 1 }; i < 4; i++)
+			{
+				int error{ squaredError(block[p], palette[i], 3) };
+				if (error < bestError)
+				{
+					bestError = error;
+					best = i;
+				}
+			}
+			indices |= static_cast<std::uint32_t>(best) << (2 * p);
+			total += bestError;
+		}
+		return total;
+	}
+}
+
+// Colour block, always 4 colour mode (color0 > color1) so it also works inside BC3
+inline void encodeBC1(const PixelBlock& block, std::uint8_t out[8])
+{
+	using namespace compression;
+
+	float mean[4], axis[4], low[4], high[4];
+	principalAxis(block, 3, mean, axis);
+	axisExtent(block, 3, mean, axis, low, high);
+
+	std::uint16_t c0{ pack565(high) };
+	std::uint16_t c1{ pack565(low) };
+	std::uint32_t indices;
+	int error{ bc1Indices(block, c0, c1, indices) };
+
+	// refit the endpoints to the indices we got
+	constexpr float indexWeights[4]{ 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	float weights[16];
+	for (int p{ 0 }; p < 16; p++)
+		weights[p] = indexWeights[indices >> (2 * p) & 3];
+	float a[4]{}, b[4]{};
+	if (leastSquaresEndpoints(block, 3, weights, a, b))
+	{
+		std::uint16_t r0{ pack565(a) };
+		std::uint16_t r1{ pack565(b) };
+		std::uint32_t refitIndices;
+		int refitError{ bc1Indices(block, r0, r1, refitIndices) };
+		if (refitError < error)
+		{
+			c0 = r0;
+			c1 = r1;
+			indices = refitIndices;
+		}
+	}
+
+	if (c0 < c1)
+	{
+		// swapping the endpoints swaps index 0 with 1 and 2 with 3
+		std::swap(c0, c1);
+		indices ^= 0x55555555u;
+	}
+	else if (c0 == c1)
+	{
+		indices = 0;
+	}
+
+	out[0] = static_cast<std::uint8_t>(c0);
+	out[1] = static_cast<std::uint8_t>(c0 >> 8);
+	out[2] = static_cast<std::uint8_t>(c1);
+	out[3] = static_cast<std::uint8_t>(c1 >> 8);
+	for (int i{ 0 }; i < 4; i++)
+		out[4 + i] = static_cast<std::uint8_t>(indices >> (8 * i));
+}
+
+inline void decodeBC1(const std::uint8_t in[8], PixelBlock& block)
+{
+	std::uint16_t c0{ static_cast<std::uint16_t>(in[0] | in[1] << 8) };
+	std::uint16_t c1{ static_cast<std::uint16_t>(in[2] | in[3] << 8) };
+	int palette[4][3];
+	compression::bc1Palette(c0, c1, palette);
+	bool threeColour{ c0 <= c1 };
+	if (threeColour)
+	{
+		for (int c{ 0 }; c < 3; c++)
+		{
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+
+	std::uint32_t indices{ static_cast<std::uint32_t>(in[4] | in[5] << 8 | in[6] << 16 | static_cast<std::uint32_t>(in[7]) << 24) };
+	for (int p{ 0 }; p < 16; p++)
+	{
+		int index{ static_cast<int>(indices >> (2 * p) & 3) };
+		for (int c{ 0 }; c < 3; c++)
+			block[p][c] = static_cast<std::uint8_t>(palette[index][c]);
+		block[p][3] = threeColour && index == 3 ? 0 : 255;
+	}
+}
+
+// BC4
+// ===
+
+namespace compression
+{
+	inline void bc4Palette(int r0, int r1, int palette[8])
+	{
+		palette[0] = r0;
+		palette[1] = r1;
+		for (int k{ 1 }; k < 7; k++)
+			palette[k + 1] = ((7 - k) * r0 + k * r1) / 7;
+	}
+}
+
+// One channel of the block
+inline void encodeBC4(const PixelBlock& block, int channel, std::uint8_t out[8])
+{
+	int low{ 255 };
+	int high{ 0 };
+	for (int p{ 0 }; p < 16; p++)
+	{
+		low = std::min<int>(low, block[p][channel]);
+		high = std::max<int>(high, block[p][channel]);
+	}
+
+	std::memset(out, 0, 8);
+	out[0] = static_cast<std::uint8_t>(high);
+	out[1] = static_cast<std::uint8_t>(low);
+	if (high == low)
+		return;
+
+	int palette[8];
+	compression::bc4Palette(high, low, palette);
+
+	int position{ 16 };
+	for (int p{ 0 }; p < 16; p++)
+	{
+		int best{ 0 };
+		int bestError{ 1 << 30 };
+		for (int i{ 0 }; i < 8; i++)
+		{
+			int error{ std::abs(block[p][channel] - palette[i]) };
+			if (error < bestError)
+			{
+				bestError = error;
+				best = i;
+			}
+		}
+		compression::putBits(out, position, static_cast<std::uint32_t>(best), 3);
+	}
+}
+
+inline void decodeBC4(const std::uint8_t in[8], PixelBlock& block, int channel)
+{
+	int r0{ in[0] };
+	int r1{ in[1] };
+	int palette[8];
+	if (r0 > r1)
+	{
+		compression::bc4Palette(r0, r1, palette);
+	}
+	else
+	{
+		palette[0] = r0;
+		palette[1] = r1;
+		for (int k{ 1 }; k < 5; k++)
+			palette[k + 1] = ((5 - k) * r0 + k * r1) / 5;
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+
+	int position{ 16 };
+	for (int p{ 0 }; p < 16; p++)
+		block[p][channel] = static_cast<std::uint8_t>(palette[compression::getBits(in, position, 3)]);
+}
+
+// BC7 mode 6
+// ==========
+
+namespace compression
+{
+	constexpr int bc7Weights4[16]{ 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+	inline int bc7Interpolate(int e0, int e1, int weight)
+	{
+		return ((64 - weight) * e0 + weight * e1 + 32) >> 6;
+	}
+
+	// 7 bit endpoint + shared p bit to the nearest representable 8 bit colour
+	inline void bc7Quantize(const float endpoint[4], int quantized[4], int& pBit)
+	{
+		int bestError{ 1 << 30 };
+		for (int p{ 0 }; p < 2; p++)
+		{
+			int candidate[4];
+			int error{ 0 };
+			for (int c{ 0 }; c < 4; c++)
+			{
+				int q{ static_cast<int>(std::lround((endpoint[c] - p) / 2.0f)) };
+				candidate[c] = std::min(std::max(q, 0), 127);
+				int value{ candidate[c] << 1 | p };
+				error += static_cast<int>((value - endpoint[c]) * (value - endpoint[c]));
+			}
+			if (error < bestError)
+			{
+				bestError = error;
+				pBit = p;
+				std::copy(candidate, candidate + 4, quantized);
+			}
+		}
+	}
+
+	inline int bc7Indices(const PixelBlock& block, const int e0[4], const int e1[4], int indices[16])
+	{
+		int palette[16][4];
+		for (int i{ 0 }; i < 16; i++)
+			for (int c{ 0 }; c < 4; c++)
+				palette[i][c] = bc7Interpolate(e0[c], e1[c], bc7Weights4[i]);
+
+		int total{ 0 };
+		for (int p{ 0 }; p < 16; p++)
+		{
+			int bestError{ 1 << 30 };
+			for (int i{ 0 }; i < 16; i++)
+			{
+				int error{ squaredError(block[p], palette[i], 4) };
+				if (error < bestError)
+				{
+					bestError = error;
+					indices[p] = i;
+				}
+			}
+			total += bestError;
+		}
+		return total;
+	}
+}
+
+inline void encodeBC7(const PixelBlock& block, std::uint8_t out[16])
+{
+	using namespace compression;
+
+	float mean[4], axis[4], low[4], high[4];
+	principalAxis(block, 4, mean, axis);
+	axisExtent(block, 4, mean, axis, low, high);
+
+	auto fit = [&block](const float a[4], const float b[4], int q0[4], int q1[4], int p[2], int indices[16]) {
+		bc7Quantize(a, q0, p[0]);
+		bc7Quantize(b, q1, p[1]);
+		int e0[4], e1[4];
+		for (int c{ 0 }; c < 4; c++)
+		{
+			e0[c] = q0[c] << 1 | p[0];
+			e1[c] = q1[c] << 1 | p[1];
+		}
+		return bc7Indices(block, e0, e1, indices);
+	};
+
+	int q0[4], q1[4], p[2], indices[16];
+	int error{ fit(low, high, q0, q1, p, indices) };
+
+	float weights[16];
+	for (int i{ 0 }; i < 16; i++)
+		weights[i] = bc7Weights4[indices[i]] / 64.0f;
+	float a[4]{}, b[4]{};
+	if (leastSquaresEndpoints(block, 4, weights, a, b))
+	{
+		int r0[4], r1[4], rp[2], refitIndices[16];
+		if (fit(a, b, r0, r1, rp, refitIndices) < error)
+		{
+			std::copy(r0, r0 + 4, q0);
+			std::copy(r1, r1 + 4, q1);
+			std::copy(rp, rp + 2, p);
+			std::copy(refitIndices, refitIndices + 16, indices);
+		}
+	}
+
+	// the first index is stored with 3 bits, so its top bit has to be 0
+	if (indices[0] >= 8)
+	{
+		for (int c{ 0 }; c < 4; c++)
+			std::swap(q0[c], q1[c]);
+		std::swap(p[0], p[1]);
+		for (int& index : indices)
+			index = 15 - index;
+	}
+
+	std::memset(out, 0, 16);
+	int position{ 0 };
+	putBits(out, position, 1u << 6, 7);
+	for (int c{ 0 }; c < 4; c++)
+	{
+		putBits(out, position, static_cast<std::uint32_t>(q0[c]), 7);
+		putBits(out, position, static_cast<std::uint32_t>(q1[c]), 7);
+	}
+	putBits(out, position, static_cast<std::uint32_t>(p[0]), 1);
+	putBits(out, position, static_cast<std::uint32_t>(p[1]), 1);
+	for (int i{ 0 }; i < 16; i++)
+		putBits(out, position, static_cast<std::uint32_t>(indices[i]), i == 0 ? 3 : 4);
+}
+
+// Only mode 6 blocks, anything else decodes to magenta
+inline void decodeBC7(const std::uint8_t in[16], PixelBlock& block)
+{
+	using namespace compression;
+
+	// the low 7 bits are the mode, bit 7 already belongs to the red endpoint
+	if ((in[0] & 0x7F) != 0x40)
+	{
+		for (int p{ 0 }; p < 16; p++)
+		{
+			block[p][0] = 255;
+			block[p][1] = 0;
+			block[p][2] = 255;
+			block[p][3] = 255;
+		}
+		return;
+	}
+
+	int position{ 7 };
+	int q[2][4];
+	for (int c{ 0 }; c < 4; c++)
+	{
+		q[0][c] = static_cast<int>(getBits(in, position, 7));
+		q[1][c] = static_cast<int>(getBits(in, position, 7));
+	}
+	int p0{ static_cast<int>(getBits(in, position, 1)) };
+	int p1{ static_cast<int>(getBits(in, position, 1)) };
+
+	for (int i{ 0 }; i < 16; i++)
+	{
+		int index{ static_cast<int>(getBits(in, position, i == 0 ? 3 : 4)) };
+		for (int c{ 0 }; c < 4; c++)
+			block[i][c] = static_cast<std::uint8_t>(bc7Interpolate(q[0][c] << 1 | p0, q[1][c] << 1 | p1, bc7Weights4[index]));
+	}
+}
+
+// ETC2 (ETC1 modes)
+// =================
+
+namespace compression
+{
+	constexpr int etcModifiers[8][4]{
+		{ 2, 8, -2, -8 }, { 5, 17, -5, -17 }, { 9, 29, -9, -29 }, { 13, 42, -13, -42 },
+		{ 18, 60, -18, -60 }, { 24, 80, -24, -80 }, { 33, 106, -33, -106 }, { 47, 183, -47, -183 },
+	};
+
+	// pixel p of the block is (x, y) = (p % 4, p / 4), ETC numbers pixels column first
+	inline int etcPixel(int x, int y) { return x * 4 + y; }
+
+	inline bool inSubBlock(int x, int y, bool flip, int subBlock)
+	{
+		return (flip ? y / 2 : x / 2) == subBlock;
+	}
+
+	inline int clamp255(int value) { return std::min(std::max(value, 0), 255); }
+
+	// Best table and modifiers for one sub-block around base, returns the error
+	inline int etcFitSubBlock(const PixelBlock& block, const int base[3], bool flip, int subBlock, int& table, std::uint32_t& bits)
+	{
+		int bestTotal{ 1 << 30 };
+		for (int t{ 0 }; t < 8; t++)
+		{
+			int total{ 0 };
+			std::uint32_t tableBits{ 0 };
+			for (int y{ 0 }; y < 4; y++)
+			{
+				for (int x{ 0 }; x < 4; x++)
+				{
+					if (!inSubBlock(x, y, flip, subBlock))
+						continue;
+
+					const std::uint8_t* pixel{ block[y * 4 + x] };
+					int bestError{ 1 << 30 };
+					int best{ 0 };
+					for (int m{ 0 }; m < 4; m++)
+					{
+						int candidate[3];
+						for (int c{ 0 }; c < 3; c++)
+							candidate[c] = clamp255(base[c] + etcModifiers[t][m]);
+						int error{ squaredError(pixel, candidate, 3) };
+						if (error < bestError)
+						{
+							bestError = error;
+							best = m;
+						}
+					}
+					total += bestError;
+					int bit{ etcPixel(x, y) };
+					tableBits |= static_cast<std::uint32_t>(best & 1) << bit;
+					tableBits |= static_cast<std::uint32_t>(best >> 1) << (16 + bit);
+				}
+			}
+			if (total < bestTotal)
+			{
+				bestTotal = total;
+				table = t;
+				bits = tableBits;
+			}
+		}
+		return bestTotal;
+	}
+
+	inline void subBlockAverage(const PixelBlock& block, bool flip, int subBlock, float average[3])
+	{
+		average[0] = average[1] = average[2] = 0.0f;
+		for (int y{ 0 }; y < 4; y++)
+			for (int x{ 0 }; x < 4; x++)
+				if (inSubBlock(x, y, flip, subBlock))
+					for (int c{ 0 }; c < 3; c++)
+						average[c] += block[y * 4 + x][c] / 8.0f;
+	}
+}
+
+inline void encodeETC2(const PixelBlock& block, std::uint8_t out[8])
+{
+	using namespace compression;
+
+	int bestError{ 1 << 30 };
+	std::uint64_t bestBlock{ 0 };
+
+	for (int flip{ 0 }; flip < 2; flip++)
+	{
+		float average[2][3];
+		subBlockAverage(block, flip, 0, average[0]);
+		subBlockAverage(block, flip, 1, average[1]);
+
+		for (int differential{ 0 }; differential < 2; differential++)
+		{
+			int stored[2][3];
+			int base[2][3];
+			bool representable{ true };
+			for (int c{ 0 }; c < 3; c++)
+			{
+				if (differential)
+				{
+					stored[0][c] = std::min(std::max(static_cast<int>(std::lround(average[0][c] * 31.0f / 255.0f)), 0), 31);
+					int second{ std::min(std::max(static_cast<int>(std::lround(average[1][c] * 31.0f / 255.0f)), 0), 31) };
+					// the second colour is a 3 bit signed delta from the first
+					int delta{ std::min(std::max(second - stored[0][c], -4), 3) };
+					stored[1][c] = delta;
+					representable = representable && stored[0][c] + delta >= 0 && stored[0][c] + delta <= 31;
+					base[0][c] = stored[0][c] << 3 | stored[0][c] >> 2;
+					int value{ stored[0][c] + delta };
+					base[1][c] = value << 3 | value >> 2;
+				}
+				else
+				{
+					for (int s{ 0 }; s < 2; s++)
+					{
+						stored[s][c] = std::min(std::max(static_cast<int>(std::lround(average[s][c] * 15.0f / 255.0f)), 0), 15);
+						base[s][c] = stored[s][c] * 17;
+					}
+				}
+			}
+			if (!representable)
+				continue;
+
+			int tables[2]{};
+			std::uint32_t bits[2]{};
+			int error{ etcFitSubBlock(block, base[0], flip, 0, tables[0], bits[0]) + etcFitSubBlock(block, base[1], flip, 1, tables[1], bits[1]) };
+			if (error >= bestError)
+				continue;
+			bestError = error;
+
+			std::uint64_t high{ 0 };
+			for (int c{ 0 }; c < 3; c++)
+			{
+				int shift{ 24 - 8 * c };
+				if (differential)
+					high |= static_cast<std::uint64_t>(stored[0][c] << 3 | (stored[1][c] & 7)) << shift;
+				else
+					high |= static_cast<std::uint64_t>(stored[0][c] << 4 | stored[1][c]) << shift;
+			}
+			high |= static_cast<std::uint64_t>(tables[0]) << 5 | static_cast<std::uint64_t>(tables[1]) << 2;
+			high |= static_cast<std::uint64_t>(differential) << 1 | static_cast<std::uint64_t>(flip);
+			bestBlock = high << 32 | (bits[0] | bits[1]);
+		}
+	}
+
+	// big endian
+	for (int i{ 0 }; i < 8; i++)
+		out[i] = static_cast<std::uint8_t>(bestBlock >> (56 - 8 * i));
+}
+
+inline void decodeETC2(const std::uint8_t in[8], PixelBlock& block)
+{
+	using namespace compression;
+
+	std::uint64_t bits{ 0 };
+	for (int i{ 0 }; i < 8; i++)
+		bits = bits << 8 | in[i];
+	std::uint32_t high{ static_cast<std::uint32_t>(bits >> 32) };
+	std::uint32_t low{ static_cast<std::uint32_t>(bits) };
+
+	bool flip{ (high & 1) != 0 };
+	bool differential{ (high & 2) != 0 };
+	int tables[2]{ static_cast<int>(high >> 5 & 7), static_cast<int>(high >> 2 & 7) };
+
+	int base[2][3];
+	for (int c{ 0 }; c < 3; c++)
+	{
+		int byte{ static_cast<int>(high >> (24 - 8 * c) & 0xFF) };
+		if (differential)
+		{
+			int first{ byte >> 3 };
+			int delta{ byte & 7 };
+			if (delta >= 4)
+				delta -= 8;
+			int second{ first + delta };
+			base[0][c] = first << 3 | first >> 2;
+			base[1][c] = second << 3 | second >> 2;
+		}
+		else
+		{
+			base[0][c] = (byte >> 4) * 17;
+			base[1][c] = (byte & 15) * 17;
+		}
+	}
+
+	for (int y{ 0 }; y < 4; y++)
+	{
+		for (int x{ 0 }; x < 4; x++)
+		{
+			int subBlock{ flip ? y / 2 : x / 2 };
+			int bit{ etcPixel(x, y) };
+			int modifier{ static_cast<int>((low >> bit & 1) | (low >> (16 + bit) & 1) << 1) };
+			for (int c{ 0 }; c < 3; c++)
+				block[y * 4 + x][c] = static_cast<std::uint8_t>(clamp255(base[subBlock][c] + etcModifiers[tables[subBlock]][modifier]));
+			block[y * 4 + x][3] = 255;
+		}
+	}
+}
+
+// Whole images
+// ============
+
+// Compresses a width x height RGBA8 image, blocks past the edge repeat the last pixel
+inline std::vector<std::uint8_t> compressImage(const std::uint8_t* pixels, int width, int height, TextureFormat format)
+{
+	std::vector<std::uint8_t> out(compressedSize(format, width, height));
+	if (!isCompressed(format))
+	{
+		std::memcpy(out.data(), pixels, out.size());
+		return out;
+	}
+
+	std::uint8_t* write{ out.data() };
+	for (int by{ 0 }; by < height; by += 4)
+	{
+		for (int bx{ 0 }; bx < width; bx += 4)
+		{
+			PixelBlock block;
+			for (int p{ 0 }; p < 16; p++)
+			{
+				int x{ std::min(bx + p % 4, width - 1) };
+				int y{ std::min(by + p / 4, height - 1) };
+				std::memcpy(block[p], pixels + (static_cast<size_t>(y) * width + x) * 4, 4);
+			}
+
+			switch (format)
+			{
+			case TextureFormat::BC1: encodeBC1(block, write); break;
+			case TextureFormat::BC3: encodeBC4(block, 3, write); encodeBC1(block, write + 8); break;
+			case TextureFormat::BC4: encodeBC4(block, 0, write); break;
+			case TextureFormat::BC5: encodeBC4(block, 0, write); encodeBC4(block, 1, write + 8); break;
+			case TextureFormat::BC7: encodeBC7(block, write); break;
+			case TextureFormat::ETC2: encodeETC2(block, write); break;
+			default: break;
+			}
+			write += blockBytes(format);
+		}
+	}
+	return out;
+}
+
+// Back to RGBA8, channels a format doesn't store come out as 0 (colour) or 255 (alpha)
+inline std::vector<std::uint8_t> decompressImage(const std::uint8_t* data, int width, int height, TextureFormat format)
+{
+	std::vector<std::uint8_t> pixels(static_cast<size_t>(width) * height * 4);
+	if (!isCompressed(format))
+	{
+		std::memcpy(pixels.data(), data, pixels.size());
+		return pixels;
+	}
+
+	const std::uint8_t* read{ data };
+	for (int by{ 0 }; by < height; by += 4)
+	{
+		for (int bx{ 0 }; bx < width; bx += 4)
+		{
+			PixelBlock block{};
+			for (int p{ 0 }; p < 16; p++)
+				block[p][3] = 255;
+
+			switch (format)
+			{
+			case TextureFormat::BC1: decodeBC1(read, block); break;
+			case TextureFormat::BC3: decodeBC1(read + 8, block); decodeBC4(read, block, 3); break;
+			case TextureFormat::BC4: decodeBC4(read, block, 0); break;
+			case TextureFormat::BC5: decodeBC4(read, block, 0); decodeBC4(read + 8, block, 1); break;
+			case TextureFormat::BC7: decodeBC7(read, block); break;
+			case TextureFormat::ETC2: decodeETC2(read, block); break;
+			default: break;
+			}
+			read += blockBytes(format);
+
+			for (int p{ 0 }; p < 16; p++)
+			{
+				int x{ bx + p % 4 };
+				int y{ by + p / 4 };
+				if (x < width && y < height)
+					std::memcpy(pixels.data() + (static_cast<size_t>(y) * width + x) * 4, block[p], 4);
+			}
+		}
+	}
+	return pixels;
+}
@@ -0,0 +1,235 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mapped_file.h"
+#include "texture_compression.h"
+
+// .htex, our own small DDS/KTX2 like container for pre-built mip chains
+//   TextureFileHeader
+//   TextureFileLevel[levels], largest level first
+//   level data, every level starts at a multiple of textureFileAlignment
+// Everything little endian
+// Files are mapped, not read, the level data goes to GL straight out of the page cache
+
+// glad here is plain 3.3 core, these come from the S3TC, BPTC and ES3 compatibility extensions
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+#ifndef GL_COMPRESSED_RGBA_BPTC_UNORM
+#define GL_COMPRESSED_RGBA_BPTC_UNORM 0x8E8C
+#endif
+#ifndef GL_COMPRESSED_RGB8_ETC2
+#define GL_COMPRESSED_RGB8_ETC2 0x9274
+#endif
+
+constexpr char textureFileMagic[4]{ 'H', 'T', 'E', 'X' };
+constexpr std::uint32_t textureFileVersion{ 1 };
+constexpr std::uint32_t textureFileAlignment{ 16 };
+
+struct TextureFileHeader
+{
+	char magic[4];
+	std::uint32_t version;
+	TextureFormat format;
+	std::uint32_t width;
+	std::uint32_t height;
+	std::uint32_t levels;
+};
+static_assert(sizeof(TextureFileHeader) == 24, "TextureFileHeader is written as is");
+
+struct TextureFileLevel
+{
+	std::uint64_t offset; // from the start of the file
+	std::uint64_t size;
+	std::uint32_t width;
+	std::uint32_t height;
+};
+static_assert(sizeof(TextureFileLevel) == 24, "TextureFileLevel is written as is");
+
+// One image of a mip chain in memory
+struct TextureLevel
+{
+	int width;
+	int height;
+	std::vector<std::uint8_t> data;
+};
+
+// A whole file mapped into memory, level offsets are relative to mapping.data()
+struct TextureFile
+{
+	TextureFileHeader header{};
+	std::vector<TextureFileLevel> levels;
+	MappedFile mapping;
+
+	const std::uint8_t* levelData(size_t level) const { return mapping.data() + levels[level].offset; }
+};
+
+inline bool isTextureFilePath(std::string_view path)
+{
+	return path.size() > 5 && path.substr(path.size() - 5) == ".htex";
+}
+
+// Source path with the extension swapped for .htex
+// Only the file name's extension, a dot in a directory name stays where it is
+inline std::string textureFilePath(std::string_view source)
+{
+	return std::filesystem::path(source).replace_extension(".htex").string();
+}
+
+inline bool writeTextureFile(const std::string& path, TextureFormat format, const std::vector<TextureLevel>& levels)
+{
+	TextureFileHeader header{};
+	std::memcpy(header.magic, textureFileMagic, 4);
+	header.version = textureFileVersion;
+	header.format = format;
+	header.width = static_cast<std::uint32_t>(levels.front().width);
+	header.height = static_cast<std::uint32_t>(levels.front().height);
+	header.levels = static_cast<std::uint32_t>(levels.size());
+
+	std::vector<TextureFileLevel> table(levels.size());
+	std::uint64_t offset{ sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * levels.size() };
+	for (size_t i{ 0 }; i < levels.size(); i++)
+	{
+		offset = (offset + textureFileAlignment - 1) / textureFileAlignment * textureFileAlignment;
+		table[i] = { offset, levels[i].data.size(), static_cast<std::uint32_t>(levels[i].width), static_cast<std::uint32_t>(levels[i].height) };
+		offset += levels[i].data.size();
+	}
+
+	std::ofstream file{ path, std::ios::binary };
+	if (!file)
+		return false;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(table.data()), sizeof(TextureFileLevel) * table.size());
+
+	std::uint64_t written{ sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * levels.size() };
+	for (size_t i{ 0 }; i < levels.size(); i++)
+	{
+		static constexpr char padding[textureFileAlignment]{};
+		file.write(padding, static_cast<std::streamsize>(table[i].offset - written));
+		file.write(reinterpret_cast<const char*>(levels[i].data.data()), static_cast<std::streamsize>(levels[i].data.size()));
+		written = table[i].offset + levels[i].data.size();
+	}
+	return static_cast<bool>(file);
+}
+
+// Checks the header and level table against the size of the file
+inline bool parseTextureFile(const std::uint8_t* bytes, size_t size, TextureFileHeader& header, std::vector<TextureFileLevel>& levels)
+{
+	if (size < sizeof(TextureFileHeader))
+		return false;
+	std::memcpy(&header, bytes, sizeof(header));
+	if (std::memcmp(header.magic, textureFileMagic, 4) != 0 || header.version != textureFileVersion || header.levels == 0 || header.levels > 32)
+		return false;
+	if (size < sizeof(TextureFileHeader) + sizeof(TextureFileLevel) * header.levels)
+		return false;
+
+	levels.resize(header.levels);
+	std::memcpy(levels.data(), bytes + sizeof(TextureFileHeader), sizeof(TextureFileLevel) * header.levels);
+	for (const TextureFileLevel& level : levels)
+	{
+		if (level.offset > size || level.size > size - level.offset)
+			return false;
+		if (level.size != compressedSize(header.format, static_cast<int>(level.width), static_cast<int>(level.height)))
+			return false;
+	}
+	return true;
+}
+
+inline bool openTextureFile(const std::string& path, TextureFile& texture)
+{
+	return texture.mapping.open(path) && parseTextureFile(texture.mapping.data(), texture.mapping.size(), texture.header, texture.levels);
+}
+
+// Only reads the header, to find out the format before committing to a file
+inline bool readTextureFileHeader(const std::string& path, TextureFileHeader& header)
+{
+	std::ifstream file{ path, std::ios::binary };
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		return false;
+	return std::memcmp(header.magic, textureFileMagic, 4) == 0 && header.version == textureFileVersion;
+}
+
+inline GLenum glInternalFormat(TextureFormat format)
+{
+	switch (format)
+	{
+	case TextureFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+	case TextureFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	case TextureFormat::BC4: return GL_COMPRESSED_RED_RGTC1;
+	case TextureFormat::BC5: return GL_COMPRESSED_RG_RGTC2;
+	case TextureFormat::BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+	case TextureFormat::ETC2: return GL_COMPRESSED_RGB8_ETC2;
+	default: return GL_RGBA8;
+	}
+}
+
+inline bool hasExtension(std::string_view name)
+{
+	GLint count{ 0 };
+	glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+	for (GLint i{ 0 }; i < count; i++)
+	{
+		const char* extension{ reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i))) };
+		if (extension && name == extension)
+			return true;
+	}
+	return false;
+}
+
+// RGTC is core in 3.3, the rest needs an extension (or GL 4.2 / 4.3)
+inline bool textureFormatSupported(TextureFormat format)
+{
+	GLint major{ 0 }, minor{ 0 };
+	glGetIntegerv(GL_MAJOR_VERSION, &major);
+	glGetIntegerv(GL_MINOR_VERSION, &minor);
+	int version{ major * 10 + minor };
+
+	switch (format)
+	{
+	case TextureFormat::BC1:
+	case TextureFormat::BC3: return hasExtension("GL_EXT_texture_compression_s3tc");
+	case TextureFormat::BC7: return version >= 42 || hasExtension("GL_ARB_texture_compression_bptc");
+	case TextureFormat::ETC2: return version >= 43 || hasExtension("GL_ARB_ES3_compatibility");
+	default: return true;
+	}
+}
+
+// The compressed version of source if --compress made one and the GPU can sample its format
+inline std::string preferTextureFile(std::string_view source)
+{
+	std::string compressed{ textureFilePath(source) };
+	TextureFileHeader header;
+	if (readTextureFileHeader(compressed, header) && textureFormatSupported(header.format))
+		return compressed;
+	return std::string(source);
+}
+
+// Level data comes from pixels, or from offsets into the bound pixel unpack buffer when pixels is null
+// Uploads onto the texture bound to GL_TEXTURE_2D
+inline void uploadTextureLevels(TextureFormat format, const std::vector<TextureFileLevel>& levels, const std::uint8_t* pixels)
+{
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, static_cast<GLint>(levels.size() - 1));
+
+	for (size_t i{ 0 }; i < levels.size(); i++)
+	{
+		const TextureFileLevel& level{ levels[i] };
+		const void* data{ reinterpret_cast<const void*>(reinterpret_cast<std::uintptr_t>(pixels) + level.offset) };
+		if (isCompressed(format))
+			glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), glInternalFormat(format), static_cast<GLsizei>(level.width), static_cast<GLsizei>(level.height), 0, static_cast<GLsizei>(level.size), data);
+		else
+			glTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(i), GL_RGBA8, static_cast<GLsizei>(level.width), static_cast<GLsizei>(level.height), 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
+	}
+}
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "gl_state.h"
+#include "mip_generator.h"
+#include "profiler.h"
+#include "stb_image.h"
+#include "texture_file.h"
+#include "thread_pool.h"
+
+// Loads textures without blocking the main thread
+// load() returns a texture name right away, holding a 1x1 placeholder colour. A worker decodes
+// the file with stb_image and builds the mip chain (no glGenerateMipmap), then update() (once per frame on the GL thread) copies finished
+// images into a pixel buffer object and respecifies the texture from it. The texture name
+// never changes, so whatever already uses it just gets the real image a few frames later
+// update() stops once this frame's byte budget is spent, but always uploads at least one image
+// .htex files skip the decode, the worker maps them and their levels are copied from the mapping
+// into the PBO and go to glCompressedTexImage2D as they are
+
+// 8 MB of texels per frame
+constexpr size_t defaultTextureUploadBudget{ 8u << 20 };
+constexpr MipFilter defaultTextureMipFilter{ MipFilter::Kaiser };
+
+struct TextureLoaderStats
+{
+	unsigned int uploads{ 0 };
+	size_t bytes{ 0 };
+};
+
+class TextureLoader
+{
+public:
+	// What the last update() did
+	TextureLoaderStats stats;
+	// Called on the GL thread with the size of every texture that gets its real image
+	std::function<void(GLuint texture, size_t bytes)> onUpload;
+	// Called on the GL thread for every texture whose file couldn't be read, it keeps the placeholder
+	std::function<void(GLuint texture)> onFailure;
+
+	TextureLoader(ThreadPool& pool, size_t uploadBudget = defaultTextureUploadBudget) : pool{ pool }, uploadBudget{ uploadBudget }
+	{
+	}
+
+	~TextureLoader()
+	{
+		// the jobs write into this object
+		pool.wait();
+	}
+
+	// colorSpace only matters for the mips of images, .htex files have theirs already
+	GLuint load(const std::string& path, glm::vec4 placeholder, TextureColorSpace colorSpace = TextureColorSpace::SRGB)
+	{
+		GLuint texture;
+		glGenTextures(1, &texture);
+		glState.bindTextureForEditing(GL_TEXTURE_2D, texture);
+
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+		glm::u8vec4 texel{ glm::clamp(placeholder, 0.0f, 1.0f) * 255.0f + 0.5f };
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, &texel);
+		glGenerateMipmap(GL_TEXTURE_2D);
+
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			inFlight++;
+		}
+		pool.submit([this, path, texture, colorSpace] { decode(path, texture, colorSpace); });
+		return texture;
+	}
+
+	// Uploads decoded images until the budget runs out, call once per frame
+	void update()
+	{
+		PROFILE_ZONE("texture uploads");
+		stats = {};
+
+		// failures count as in flight until they're reported here, so finish() waits for them too
+		std::vector<GLuint> failures;
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			failures.swap(failed);
+			inFlight -= static_cast<unsigned int>(failures.size());
+		}
+		if (onFailure)
+			for (GLuint texture : failures)
+				onFailure(texture);
+
+		while (true)
+		{
+			Decoded image;
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				if (decoded.empty())
+					break;
+				size_t bytes{ decoded.front().size() };
+				if (stats.uploads > 0 && stats.bytes + bytes > uploadBudget)
+					break;
+				image = std::move(decoded.front());
+				decoded.erase(decoded.begin());
+			}
+			upload(image);
+		}
+	}
+
+	// Blocks until every requested texture is uploaded
+	void finish()
+	{
+		pool.wait();
+		while (pending() > 0)
+			update();
+	}
+
+	// Textures requested but not uploaded yet
+	unsigned int pending()
+	{
+		std::lock_guard<std::mutex> lock{ mutex };
+		return inFlight;
+	}
+
+private:
+	struct Decoded
+	{
+		GLuint texture{ 0 };
+		int width{ 0 };
+		int height{ 0 };
+		// Level offsets are into either the RGBA8 mip chain built from an image or a mapped .htex
+		TextureFormat format{ TextureFormat::RGBA8 };
+		std::vector<TextureFileLevel> levels;
+		std::vector<unsigned char> pixels;
+		MappedFile mapping;
+
+		const unsigned char* data() const { return mapping.isOpen() ? mapping.data() : pixels.data(); }
+		size_t size() const { return mapping.isOpen() ? mapping.size() : pixels.size(); }
+	};
+
+	ThreadPool& pool;
+	size_t uploadBudget;
+
+	std::mutex mutex;
+	std::vector<Decoded> decoded;
+	std::vector<GLuint> failed;
+	unsigned int inFlight{ 0 };
+
+	GLuint PBO{ 0 };
+	size_t PBOSize{ 0 };
+
+	// Runs on a worker
+	void decode(const std::string& path, GLuint texture, TextureColorSpace colorSpace)
+	{
+		PROFILE_ZONE("decode texture");
+		stbi_set_flip_vertically_on_load_thread(true);
+
+		Decoded image;
+		image.texture = texture;
+
+		if (isTextureFilePath(path))
+		{
+			TextureFile file;
+			bool loaded{ openTextureFile(path, file) };
+			// page faults happen here rather than in the memcpy on the GL thread
+			if (loaded)
+				file.mapping.prefetch();
+
+			std::lock_guard<std::mutex> lock{ mutex };
+			if (!loaded)
+			{
+				std::cerr << "FAILED to create texture " << path << '\n';
+				failed.push_back(texture);
+				return;
+			}
+			image.width = static_cast<int>(file.header.width);
+			image.height = static_cast<int>(file.header.height);
+			image.format = file.header.format;
+			image.levels = std::move(file.levels);
+			image.mapping = std::move(file.mapping);
+			decoded.push_back(std::move(image));
+			return;
+		}
+
+		int channels;
+		unsigned char* data{ stbi_load(path.c_str(), &image.width, &image.height, &channels, 4) };
+
+		if (!data)
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			// the placeholder stays
+			std::cerr << "FAILED to create texture " << path << '\n';
+			failed.push_back(texture);
+			return;
+		}
+		TextureLevel base{ image.width, image.height, std::vector<std::uint8_t>(data, data + static_cast<size_t>(image.width) * image.height * 4) };
+		stbi_image_free(data);
+
+		// all levels end to end, laid out like a .htex so upload() doesn't care where they came from
+		std::vector<TextureLevel> chain;
+		{
+			PROFILE_ZONE("generate mips");
+			chain = generateMipChain(std::move(base), defaultTextureMipFilter, colorSpace);
+		}
+		for (const TextureLevel& level : chain)
+		{
+			image.levels.push_back({ image.pixels.size(), level.data.size(), static_cast<std::uint32_t>(level.width), static_cast<std::uint32_t>(level.height) });
+			image.pixels.insert(image.pixels.end(), level.data.begin(), level.data.end());
+		}
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		decoded.push_back(std::move(image));
+	}
+
+	void upload(const Decoded& image)
+	{
+		if (PBO == 0)
+			glGenBuffers(1, &PBO);
+		glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, PBO);
+
+		// orphaned every time so the copy doesn't wait for the previous upload to be read
+		size_t bytes{ image.size() };
+		PBOSize = std::max(PBOSize, bytes);
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, static_cast<GLsizeiptr>(PBOSize), nullptr, GL_STREAM_DRAW);
+		void* staging{ glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, static_cast<GLsizeiptr>(bytes), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT) };
+		if (staging)
+		{
+			std::memcpy(staging, image.data(), bytes);
+			glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		}
+		else
+		{
+			// couldn't map it, upload straight from the decoded pixels (or the file mapping) instead
+			glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+
+		// with a pixel unpack buffer bound the data pointer is an offset into it
+		const unsigned char* source{ staging ? nullptr : image.data() };
+		glState.bindTextureForEditing(GL_TEXTURE_2D, image.texture);
+		uploadTextureLevels(image.format, image.levels, source);
+
+		// anything else uploading pixels expects client memory
+		glState.bindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		stats.uploads++;
+		stats.bytes += bytes;
+		if (onUpload)
+		{
+			size_t levelBytes{ 0 };
+			for (const TextureFileLevel& level : image.levels)
+				levelBytes += level.size;
+			onUpload(image.texture, levelBytes);
+		}
+
+		std::lock_guard<std::mutex> lock{ mutex };
+		inFlight--;
+	}
+};
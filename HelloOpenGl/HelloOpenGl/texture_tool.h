@@ -0,0 +1,135 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mip_generator.h"
+#include "stb_image.h"
+#include "texture_compression.h"
+#include "texture_file.h"
+
+// The offline part of texture compression: --compress image.png --format bc7
+// writes image.htex next to the source with the whole mip chain compressed
+// --filter box|kaiser|lanczos picks the mip filter, --linear is for data maps like specular
+// Runs before any window or GL context exists
+
+// bc1, bc3, bc4, bc5, bc7, etc2 or rgba8, false if the name is none of them
+inline bool parseTextureFormat(std::string_view name, TextureFormat& format)
+{
+	constexpr std::pair<std::string_view, TextureFormat> names[]{
+		{ "rgba8", TextureFormat::RGBA8 }, { "bc1", TextureFormat::BC1 }, { "bc3", TextureFormat::BC3 }, { "bc4", TextureFormat::BC4 },
+		{ "bc5", TextureFormat::BC5 }, { "bc7", TextureFormat::BC7 }, { "etc2", TextureFormat::ETC2 },
+	};
+	for (const auto& [text, value] : names)
+	{
+		if (text == name)
+		{
+			format = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+// box, kaiser or lanczos
+inline bool parseMipFilter(std::string_view name, MipFilter& filter)
+{
+	constexpr std::pair<std::string_view, MipFilter> names[]{ { "box", MipFilter::Box }, { "kaiser", MipFilter::Kaiser }, { "lanczos", MipFilter::Lanczos } };
+	for (const auto& [text, value] : names)
+	{
+		if (text == name)
+		{
+			filter = value;
+			return true;
+		}
+	}
+	return false;
+}
+
+// Every level of chain in format
+inline std::vector<TextureLevel> compressMipChain(const std::vector<TextureLevel>& chain, TextureFormat format)
+{
+	std::vector<TextureLevel> compressed;
+	for (const TextureLevel& level : chain)
+		compressed.push_back({ level.width, level.height, compressImage(level.data.data(), level.width, level.height, format) });
+	return compressed;
+}
+
+// Peak signal to noise ratio over the channels the format keeps
+inline double compressionPSNR(const std::vector<std::uint8_t>& original, const std::vector<std::uint8_t>& decoded, TextureFormat format)
+{
+	int channels{ 4 };
+	if (format == TextureFormat::BC1 || format == TextureFormat::ETC2)
+		channels = 3;
+	else if (format == TextureFormat::BC4)
+		channels = 1;
+	else if (format == TextureFormat::BC5)
+		channels = 2;
+
+	double squared{ 0.0 };
+	for (size_t p{ 0 }; p < original.size(); p += 4)
+		for (int c{ 0 }; c < channels; c++)
+			squared += (original[p + c] - decoded[p + c]) * (original[p + c] - decoded[p + c]);
+	double mse{ squared / (original.size() / 4 * channels) };
+	return mse == 0.0 ? 99.0 : 10.0 * std::log10(255.0 * 255.0 / mse);
+}
+
+inline int compressTextureTool(std::string_view input, std::string_view formatName, std::string_view filterName, TextureColorSpace colorSpace)
+{
+	TextureFormat format;
+	if (!parseTextureFormat(formatName, format))
+	{
+		std::cout << "Unknown format " << formatName << ", use bc1, bc3, bc4, bc5, bc7, etc2 or rgba8\n";
+		return 1;
+	}
+	MipFilter filter;
+	if (!parseMipFilter(filterName, filter))
+	{
+		std::cout << "Unknown filter " << filterName << ", use box, kaiser or lanczos\n";
+		return 1;
+	}
+
+	// same orientation as the textures the app loads
+	stbi_set_flip_vertically_on_load(true);
+	int width, height, channels;
+	unsigned char* pixels{ stbi_load(std::string(input).c_str(), &width, &height, &channels, 4) };
+	if (!pixels)
+	{
+		std::cout << "FAILED to load " << input << '\n';
+		return 1;
+	}
+	TextureLevel base{ width, height, std::vector<std::uint8_t>(pixels, pixels + static_cast<size_t>(width) * height * 4) };
+	stbi_image_free(pixels);
+
+	auto start{ std::chrono::steady_clock::now() };
+	std::vector<TextureLevel> chain{ generateMipChain(std::move(base), filter, colorSpace) };
+
+	std::vector<TextureLevel> compressed{ compressMipChain(chain, format) };
+	size_t uncompressedBytes{ 0 };
+	size_t compressedBytes{ 0 };
+	for (size_t i{ 0 }; i < chain.size(); i++)
+	{
+		uncompressedBytes += chain[i].data.size();
+		compressedBytes += compressed[i].data.size();
+	}
+	double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+
+	std::string output{ textureFilePath(input) };
+	if (!writeTextureFile(output, format, compressed))
+	{
+		std::cout << "FAILED to write " << output << '\n';
+		return 1;
+	}
+
+	std::vector<std::uint8_t> decoded{ decompressImage(compressed.front().data.data(), width, height, format) };
+	std::cout << input << " -> " << output << ": " << width << "x" << height << ", " << chain.size() << " levels, ";
+	std::cout << uncompressedBytes / 1024 << " KB -> " << compressedBytes / 1024 << " KB, ";
+	std::cout << "PSNR " << compressionPSNR(chain.front().data, decoded, format) << " dB, " << seconds * 1000.0 << " ms\n";
+	return 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "profiler.h"
+
+// Fixed set of worker threads running jobs in the order they were submitted
+// Jobs must not touch GL, the context only lives on the main thread
+
+class ThreadPool
+{
+public:
+	// one thread less than the machine has, the main thread keeps rendering
+	explicit ThreadPool(unsigned int threadCount = defaultThreadCount())
+	{
+		for (unsigned int i{ 0 }; i < std::max(threadCount, 1u); i++)
+			workers.emplace_back([this] { run(); });
+	}
+
+	// hardware_concurrency() is 0 when it can't tell
+	static unsigned int defaultThreadCount()
+	{
+		unsigned int hardware{ std::thread::hardware_concurrency() };
+		return hardware > 1 ? hardware - 1 : 1;
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& worker : workers)
+			worker.join();
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void submit(std::function<void()> job)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ mutex };
+			jobs.push(std::move(job));
+		}
+		wake.notify_one();
+	}
+
+	// Blocks until every submitted job has finished
+	void wait()
+	{
+		std::unique_lock<std::mutex> lock{ mutex };
+		idle.wait(lock, [this] { return jobs.empty() && running == 0; });
+	}
+
+	size_t size() const { return workers.size(); }
+
+private:
+	std::vector<std::thread> workers;
+	std::queue<std::function<void()>> jobs;
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	unsigned int running{ 0 };
+	bool stopping{ false };
+
+	void run()
+	{
+		profiler.nameThread("worker");
+
+		while (true)
+		{
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock{ mutex };
+				wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+				if (jobs.empty())
+					return;
+				job = std::move(jobs.front());
+				jobs.pop();
+				running++;
+			}
+
+			job();
+
+			{
+				std::lock_guard<std::mutex> lock{ mutex };
+				running--;
+				if (jobs.empty() && running == 0)
+					idle.notify_all();
+			}
+		}
+	}
+};
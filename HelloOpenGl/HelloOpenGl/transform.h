@@ -0,0 +1,327 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Batch model matrix composition
+// model = translate(position) * rotate(angle, axis) * shared, for every instance at once
+// Every result is rigid, so the upper 3x3 of model is its own normal matrix and the vertex
+// shader uses that instead of inverting anything or reading a second matrix
+// The AVX2 kernel is used when compiled with /arch:AVX2 (-mavx2 -mfma), SSE2 otherwise,
+// and the scalar loop handles the leftover instances and anything without SSE2
+// It uses FMA too, MSVC doesn't define __FMA__ but /arch:AVX2 always comes with it
+
+#if defined(__AVX2__) && (defined(__FMA__) || defined(_MSC_VER))
+#define TRANSFORM_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_SSE2
+#include <emmintrin.h>
+#endif
+
+// What gets uploaded per instance
+struct InstanceTransform
+{
+	// rotation and translation only, the vertex shader takes mat3(model) as the normal matrix
+	glm::mat4 model;
+	// texture array layer with --material-array, the kernels below never touch it
+	std::uint32_t material{ 0 };
+};
+
+// Positions, rotation axes and angles in structure of arrays form so the kernels can load 4 or 8 of each at once
+struct TransformBatch
+{
+	std::vector<float> x, y, z;
+	// normalized
+	std::vector<float> axisX, axisY, axisZ;
+	// radians, within [-pi, pi]
+	std::vector<float> angle;
+
+	void resize(size_t count)
+	{
+		for (std::vector<float>* array : { &x, &y, &z, &axisX, &axisY, &axisZ, &angle })
+			array->resize(count);
+	}
+
+	size_t size() const { return x.size(); }
+
+	void set(size_t i, glm::vec3 position, glm::vec3 axis, float radians)
+	{
+		axis = glm::normalize(axis);
+		x[i] = position.x;
+		y[i] = position.y;
+		z[i] = position.z;
+		axisX[i] = axis.x;
+		axisY[i] = axis.y;
+		axisZ[i] = axis.z;
+		// the kernels' sin and cos only reduce by quadrant in float, big angles would lose most of their bits
+		angle[i] = static_cast<float>(std::remainder(static_cast<double>(radians), 2.0 * glm::pi<double>()));
+	}
+};
+
+// Writes instance i, r is the 3x3 rotation in column major order
+// shared has to be a rotation too, then the whole upper 3x3 is one
+inline void writeInstance(InstanceTransform& out, const float r[9], const glm::mat3& shared, float x, float y, float z)
+{
+	// rotation * shared, column by column
+	for (int column{ 0 }; column < 3; column++)
+	{
+		out.model[column] = glm::vec4(
+			r[0] * shared[column][0] + r[3] * shared[column][1] + r[6] * shared[column][2],
+			r[1] * shared[column][0] + r[4] * shared[column][1] + r[7] * shared[column][2],
+			r[2] * shared[column][0] + r[5] * shared[column][1] + r[8] * shared[column][2], 0.0f);
+	}
+	out.model[3] = glm::vec4(x, y, z, 1.0f);
+}
+
+// Plain loop, also does the tail the SIMD kernels leave over
+inline void composeModelsScalar(const TransformBatch& batch, const glm::mat3& shared, InstanceTransform* out, size_t first, size_t last)
+{
+	for (size_t i{ first }; i < last; i++)
+	{
+		float c{ std::cos(batch.angle[i]) };
+		float s{ std::sin(batch.angle[i]) };
+		float t{ 1.0f - c };
+		float ax{ batch.axisX[i] };
+		float ay{ batch.axisY[i] };
+		float az{ batch.axisZ[i] };
+
+		// Rodrigues' formula, same matrix glm::rotate builds
+		const float r[9] = {
+			t * ax * ax + c,      t * ax * ay + s * az, t * ax * az - s * ay,
+			t * ax * ay - s * az, t * ay * ay + c,      t * ay * az + s * ax,
+			t * ax * az + s * ay, t * ay * az - s * ax, t * az * az + c,
+		};
+		writeInstance(out[i], r, shared, batch.x[i], batch.y[i], batch.z[i]);
+	}
+}
+
+#if defined(TRANSFORM_SSE2)
+
+// sin and cos of 4 angles, Cephes style: reduce to [-pi/4, pi/4] by quadrant and use minimax polynomials
+inline void sincos4(__m128 x, __m128& sinOut, __m128& cosOut)
+{
+	const __m128 twoOverPi{ _mm_set1_ps(0.636619772f) };
+	__m128i quadrant{ _mm_cvtps_epi32(_mm_mul_ps(x, twoOverPi)) };
+	__m128 q{ _mm_cvtepi32_ps(quadrant) };
+
+	// x - q * pi/2 with pi/2 split in three parts to keep precision
+	x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(1.5703125f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(4.837512969970703125e-4f)));
+	x = _mm_sub_ps(x, _mm_mul_ps(q, _mm_set1_ps(7.54978995489188216e-8f)));
+
+	__m128 x2{ _mm_mul_ps(x, x) };
+
+	__m128 sinPoly{ _mm_set1_ps(-1.9515295891e-4f) };
+	sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, x2), _mm_set1_ps(8.3321608736e-3f));
+	sinPoly = _mm_add_ps(_mm_mul_ps(sinPoly, x2), _mm_set1_ps(-1.6666654611e-1f));
+	sinPoly = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sinPoly, x2), x), x);
+
+	__m128 cosPoly{ _mm_set1_ps(2.443315711809948e-5f) };
+	cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, x2), _mm_set1_ps(-1.388731625493765e-3f));
+	cosPoly = _mm_add_ps(_mm_mul_ps(cosPoly, x2), _mm_set1_ps(4.166664568298827e-2f));
+	cosPoly = _mm_mul_ps(_mm_mul_ps(cosPoly, x2), x2);
+	cosPoly = _mm_add_ps(_mm_sub_ps(cosPoly, _mm_mul_ps(x2, _mm_set1_ps(0.5f))), _mm_set1_ps(1.0f));
+
+	// odd quadrants swap sin and cos
+	__m128 swap{ _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(1))) };
+	__m128 s{ _mm_or_ps(_mm_and_ps(swap, cosPoly), _mm_andnot_ps(swap, sinPoly)) };
+	__m128 c{ _mm_or_ps(_mm_and_ps(swap, sinPoly), _mm_andnot_ps(swap, cosPoly)) };
+
+	// sin is negative in quadrants 2 and 3, cos in quadrants 1 and 2
+	__m128 sinSign{ _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30)) };
+	__m128 cosSign{ _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(quadrant, _mm_set1_epi32(1)), _mm_set1_epi32(2)), 30)) };
+	sinOut = _mm_xor_ps(s, sinSign);
+	cosOut = _mm_xor_ps(c, cosSign);
+}
+
+inline void composeModelsSSE(const TransformBatch& batch, const glm::mat3& shared, InstanceTransform* out, size_t count)
+{
+	const __m128 one{ _mm_set1_ps(1.0f) };
+	const __m128 zero{ _mm_setzero_ps() };
+
+	for (size_t i{ 0 }; i < count; i += 4)
+	{
+		__m128 ax{ _mm_loadu_ps(&batch.axisX[i]) };
+		__m128 ay{ _mm_loadu_ps(&batch.axisY[i]) };
+		__m128 az{ _mm_loadu_ps(&batch.axisZ[i]) };
+
+		__m128 s, c;
+		sincos4(_mm_loadu_ps(&batch.angle[i]), s, c);
+		__m128 t{ _mm_sub_ps(one, c) };
+
+		__m128 txy{ _mm_mul_ps(_mm_mul_ps(t, ax), ay) };
+		__m128 txz{ _mm_mul_ps(_mm_mul_ps(t, ax), az) };
+		__m128 tyz{ _mm_mul_ps(_mm_mul_ps(t, ay), az) };
+
+		// rotation columns, same layout as the scalar r[]
+		__m128 r[9] = {
+			_mm_add_ps(_mm_mul_ps(_mm_mul_ps(t, ax), ax), c), _mm_add_ps(txy, _mm_mul_ps(s, az)), _mm_sub_ps(txz, _mm_mul_ps(s, ay)),
+			_mm_sub_ps(txy, _mm_mul_ps(s, az)), _mm_add_ps(_mm_mul_ps(_mm_mul_ps(t, ay), ay), c), _mm_add_ps(tyz, _mm_mul_ps(s, ax)),
+			_mm_add_ps(txz, _mm_mul_ps(s, ay)), _mm_sub_ps(tyz, _mm_mul_ps(s, ax)), _mm_add_ps(_mm_mul_ps(_mm_mul_ps(t, az), az), c),
+		};
+
+		__m128 columns[4][4];
+		for (int column{ 0 }; column < 3; column++)
+		{
+			__m128 s0{ _mm_set1_ps(shared[column][0]) };
+			__m128 s1{ _mm_set1_ps(shared[column][1]) };
+			__m128 s2{ _mm_set1_ps(shared[column][2]) };
+			for (int row{ 0 }; row < 3; row++)
+				columns[column][row] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(r[row], s0), _mm_mul_ps(r[3 + row], s1)), _mm_mul_ps(r[6 + row], s2));
+			columns[column][3] = zero;
+		}
+		columns[3][0] = _mm_loadu_ps(&batch.x[i]);
+		columns[3][1] = _mm_loadu_ps(&batch.y[i]);
+		columns[3][2] = _mm_loadu_ps(&batch.z[i]);
+		columns[3][3] = one;
+
+		// lanes hold instances, transpose so each register holds one column of one instance
+		for (int column{ 0 }; column < 4; column++)
+		{
+			__m128* v{ columns[column] };
+			_MM_TRANSPOSE4_PS(v[0], v[1], v[2], v[3]);
+			for (int lane{ 0 }; lane < 4; lane++)
+				_mm_storeu_ps(&out[i + lane].model[column][0], v[lane]);
+		}
+	}
+}
+
+#endif
+
+#if defined(TRANSFORM_AVX2)
+
+// Same as sincos4 for 8 angles
+inline void sincos8(__m256 x, __m256& sinOut, __m256& cosOut)
+{
+	__m256i quadrant{ _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(0.636619772f))) };
+	__m256 q{ _mm256_cvtepi32_ps(quadrant) };
+
+	x = _mm256_fnmadd_ps(q, _mm256_set1_ps(1.5703125f), x);
+	x = _mm256_fnmadd_ps(q, _mm256_set1_ps(4.837512969970703125e-4f), x);
+	x = _mm256_fnmadd_ps(q, _mm256_set1_ps(7.54978995489188216e-8f), x);
+
+	__m256 x2{ _mm256_mul_ps(x, x) };
+
+	__m256 sinPoly{ _mm256_set1_ps(-1.9515295891e-4f) };
+	sinPoly = _mm256_fmadd_ps(sinPoly, x2, _mm256_set1_ps(8.3321608736e-3f));
+	sinPoly = _mm256_fmadd_ps(sinPoly, x2, _mm256_set1_ps(-1.6666654611e-1f));
+	sinPoly = _mm256_fmadd_ps(_mm256_mul_ps(sinPoly, x2), x, x);
+
+	__m256 cosPoly{ _mm256_set1_ps(2.443315711809948e-5f) };
+	cosPoly = _mm256_fmadd_ps(cosPoly, x2, _mm256_set1_ps(-1.388731625493765e-3f));
+	cosPoly = _mm256_fmadd_ps(cosPoly, x2, _mm256_set1_ps(4.166664568298827e-2f));
+	cosPoly = _mm256_mul_ps(_mm256_mul_ps(cosPoly, x2), x2);
+	cosPoly = _mm256_add_ps(_mm256_fnmadd_ps(x2, _mm256_set1_ps(0.5f), cosPoly), _mm256_set1_ps(1.0f));
+
+	__m256 swap{ _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(1))) };
+	__m256 s{ _mm256_blendv_ps(sinPoly, cosPoly, swap) };
+	__m256 c{ _mm256_blendv_ps(cosPoly, sinPoly, swap) };
+
+	__m256 sinSign{ _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(quadrant, _mm256_set1_epi32(2)), 30)) };
+	__m256 cosSign{ _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(quadrant, _mm256_set1_epi32(1)), _mm256_set1_epi32(2)), 30)) };
+	sinOut = _mm256_xor_ps(s, sinSign);
+	cosOut = _mm256_xor_ps(c, cosSign);
+}
+
+inline void composeModelsAVX2(const TransformBatch& batch, const glm::mat3& shared, InstanceTransform* out, size_t count)
+{
+	const __m256 one{ _mm256_set1_ps(1.0f) };
+	const __m256 zero{ _mm256_setzero_ps() };
+
+	for (size_t i{ 0 }; i < count; i += 8)
+	{
+		__m256 ax{ _mm256_loadu_ps(&batch.axisX[i]) };
+		__m256 ay{ _mm256_loadu_ps(&batch.axisY[i]) };
+		__m256 az{ _mm256_loadu_ps(&batch.axisZ[i]) };
+
+		__m256 s, c;
+		sincos8(_mm256_loadu_ps(&batch.angle[i]), s, c);
+		__m256 t{ _mm256_sub_ps(one, c) };
+
+		__m256 tx{ _mm256_mul_ps(t, ax) };
+		__m256 txy{ _mm256_mul_ps(tx, ay) };
+		__m256 txz{ _mm256_mul_ps(tx, az) };
+		__m256 tyz{ _mm256_mul_ps(_mm256_mul_ps(t, ay), az) };
+
+		__m256 r[9] = {
+			_mm256_fmadd_ps(tx, ax, c), _mm256_fmadd_ps(s, az, txy), _mm256_fnmadd_ps(s, ay, txz),
+			_mm256_fnmadd_ps(s, az, txy), _mm256_fmadd_ps(_mm256_mul_ps(t, ay), ay, c), _mm256_fmadd_ps(s, ax, tyz),
+			_mm256_fmadd_ps(s, ay, txz), _mm256_fnmadd_ps(s, ax, tyz), _mm256_fmadd_ps(_mm256_mul_ps(t, az), az, c),
+		};
+
+		__m256 columns[4][4];
+		for (int column{ 0 }; column < 3; column++)
+		{
+			__m256 s0{ _mm256_set1_ps(shared[column][0]) };
+			__m256 s1{ _mm256_set1_ps(shared[column][1]) };
+			__m256 s2{ _mm256_set1_ps(shared[column][2]) };
+			for (int row{ 0 }; row < 3; row++)
+				columns[column][row] = _mm256_fmadd_ps(r[6 + row], s2, _mm256_fmadd_ps(r[3 + row], s1, _mm256_mul_ps(r[row], s0)));
+			columns[column][3] = zero;
+		}
+		columns[3][0] = _mm256_loadu_ps(&batch.x[i]);
+		columns[3][1] = _mm256_loadu_ps(&batch.y[i]);
+		columns[3][2] = _mm256_loadu_ps(&batch.z[i]);
+		columns[3][3] = one;
+
+		// transpose each 128 bit half on its own, the low half is instances 0-3 and the high half 4-7
+		for (int column{ 0 }; column < 4; column++)
+		{
+			__m256* v{ columns[column] };
+			__m256 t0{ _mm256_unpacklo_ps(v[0], v[1]) };
+			__m256 t1{ _mm256_unpackhi_ps(v[0], v[1]) };
+			__m256 t2{ _mm256_unpacklo_ps(v[2], v[3]) };
+			__m256 t3{ _mm256_unpackhi_ps(v[2], v[3]) };
+			__m256 lanes[4] = {
+				_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(1, 0, 1, 0)),
+				_mm256_shuffle_ps(t0, t2, _MM_SHUFFLE(3, 2, 3, 2)),
+				_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(1, 0, 1, 0)),
+				_mm256_shuffle_ps(t1, t3, _MM_SHUFFLE(3, 2, 3, 2)),
+			};
+			for (int lane{ 0 }; lane < 4; lane++)
+			{
+				__m128 low{ _mm256_castps256_ps128(lanes[lane]) };
+				__m128 high{ _mm256_extractf128_ps(lanes[lane], 1) };
+				_mm_storeu_ps(&out[i + lane].model[column][0], low);
+				_mm_storeu_ps(&out[i + 4 + lane].model[column][0], high);
+			}
+		}
+	}
+}
+
+#endif
+
+// Fills out[0 .. batch.size()) with translate(position) * rotate(angle, axis) * shared
+// shared must be a pure rotation, then every result is rigid and the normal matrix is just the upper 3x3
+inline void composeModels(const TransformBatch& batch, const glm::mat3& shared, InstanceTransform* out)
+{
+	size_t count{ batch.size() };
+	size_t vectorized{ 0 };
+
+#if defined(TRANSFORM_AVX2)
+	vectorized = count - count % 8;
+	composeModelsAVX2(batch, shared, out, vectorized);
+#elif defined(TRANSFORM_SSE2)
+	vectorized = count - count % 4;
+	composeModelsSSE(batch, shared, out, vectorized);
+#endif
+
+	composeModelsScalar(batch, shared, out, vectorized, count);
+}
+
+// Which kernel composeModels uses, for printing
+inline const char* transformKernelName()
+{
+#if defined(TRANSFORM_AVX2)
+	return "AVX2";
+#elif defined(TRANSFORM_SSE2)
+	return "SSE2";
+#else
+	return "scalar";
+#endif
+}
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <cstring>
+
+#include "gl_state.h"
+
+// Uniform blocks that every program shares
+// The structs mirror the std140 layout of the blocks declared in the shaders,
+// vec3 takes 16 bytes in std140 so every vec3 is followed by a float (or padding)
+
+// Uniform uploads issued and skipped because the value didn't change
+// Counts both Shader setters and UniformBuffer uploads, the render loop resets it every frame
+struct UniformStats
+{
+	unsigned int issued{ 0 };
+	unsigned int elided{ 0 };
+};
+
+inline UniformStats uniformStats;
+
+constexpr int maxPointLights{ 4 }; // NR_POINT_LIGHTS in FragmentShader.frag
+
+// Fixed binding points, Shader binds any block with a matching name after linking
+enum UniformBinding : GLuint
+{
+	CameraBinding = 0,
+	LightsBinding = 1,
+};
+
+// layout (std140) uniform Camera
+struct CameraBlock
+{
+	glm::mat4 view;
+	glm::mat4 projection;
+	glm::vec3 position;
+	float padding;
+};
+static_assert(sizeof(CameraBlock) == 144, "CameraBlock must match std140");
+
+struct DirLightBlock
+{
+	glm::vec3 direction;
+	float padding0;
+	glm::vec3 ambient;
+	float padding1;
+	glm::vec3 diffuse;
+	float padding2;
+	glm::vec3 specular;
+	float padding3;
+};
+static_assert(sizeof(DirLightBlock) == 64, "DirLightBlock must match std140");
+
+// the attenuation terms sit in the vec3 padding
+struct PointLightBlock
+{
+	glm::vec3 position;
+	float constant;
+	glm::vec3 ambient;
+	float linear;
+	glm::vec3 diffuse;
+	float quadratic;
+	glm::vec3 specular;
+	float padding;
+};
+static_assert(sizeof(PointLightBlock) == 64, "PointLightBlock must match std140");
+
+// layout (std140) uniform Lights
+struct LightsBlock
+{
+	DirLightBlock dirLight;
+	PointLightBlock pointLights[maxPointLights];
+};
+static_assert(sizeof(LightsBlock) == 64 + 64 * maxPointLights, "LightsBlock must match std140");
+
+// Binds the shared blocks a program uses to their binding points, called by Shader after linking
+inline void bindSharedBlocks(GLuint program)
+{
+	constexpr struct { const char* name; GLuint binding; } blocks[] = {
+		{ "Camera", CameraBinding },
+		{ "Lights", LightsBinding },
+	};
+
+	for (const auto& block : blocks)
+	{
+		GLuint index{ glGetUniformBlockIndex(program, block.name) };
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(program, index, block.binding);
+	}
+}
+
+// A uniform buffer holding one Block, attached to its binding point for the whole program lifetime
+// Fill data on the CPU and call upload() once per frame, it does nothing if data didn't change
+template <typename Block>
+class UniformBuffer
+{
+public:
+	GLuint ID;
+	Block data{};
+
+	explicit UniformBuffer(GLuint binding)
+	{
+		glGenBuffers(1, &ID);
+		glState.bindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+		glState.bindBufferBase(GL_UNIFORM_BUFFER, binding, ID);
+	}
+
+	void upload()
+	{
+		if (uploadedValid && std::memcmp(&uploaded, &data, sizeof(Block)) == 0)
+		{
+			uniformStats.elided++;
+			return;
+		}
+
+		glState.bindBuffer(GL_UNIFORM_BUFFER, ID);
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Block), &data);
+		uploaded = data;
+		uploadedValid = true;
+		uniformStats.issued++;
+	}
+
+private:
+	// copy of what the GPU buffer holds
+	Block uploaded{};
+	bool uploadedValid{ false };
+};
@@ -0,0 +1,170 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+#include "mesh.h"
+
+// Vertex layouts the cube VAOs can use, both feed the same vertex shaders
+// Float:   position 3 floats, normal 3 floats, uv 2 floats = 32 bytes
+// Compact: position 3 shorts quantized to the mesh bounds (+ padding), normal GL_INT_2_10_10_10_REV,
+//          uv 2 half floats = 16 bytes
+// The shaders decode the position with positionScale * aPos + positionOffset,
+// which is just 1 and 0 for the float layout
+
+enum class VertexLayout
+{
+	Float,
+	Compact,
+};
+
+struct CompactVertex
+{
+	std::int16_t position[4];
+	std::uint32_t normal;
+	std::uint16_t uv[2];
+};
+static_assert(sizeof(CompactVertex) == 16, "CompactVertex must stay 16 bytes");
+
+// What the vertex buffer gets filled with plus how to undo the position quantization
+struct VertexData
+{
+	std::vector<unsigned char> bytes;
+	glm::vec3 positionScale{ 1.0f };
+	glm::vec3 positionOffset{ 0.0f };
+};
+
+// IEEE half float, round to nearest even, flushes values too small for a half to zero
+inline std::uint16_t floatToHalf(float value)
+{
+	std::uint32_t bits;
+	std::memcpy(&bits, &value, sizeof(bits));
+
+	std::uint32_t sign{ (bits >> 16) & 0x8000u };
+	std::int32_t exponent{ static_cast<std::int32_t>((bits >> 23) & 0xFF) - 127 + 15 };
+	std::uint32_t mantissa{ bits & 0x7FFFFFu };
+
+	// NaN and infinity
+	if (((bits >> 23) & 0xFF) == 0xFF)
+		return static_cast<std::uint16_t>(sign | 0x7C00u | (mantissa ? 0x200u : 0u));
+	if (exponent >= 31)
+		return static_cast<std::uint16_t>(sign | 0x7C00u);
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+			return static_cast<std::uint16_t>(sign);
+		// subnormal half
+		mantissa |= 0x800000u;
+		std::uint32_t shift{ static_cast<std::uint32_t>(14 - exponent) };
+		std::uint32_t half{ mantissa >> shift };
+		std::uint32_t rest{ mantissa & ((1u << shift) - 1) };
+		std::uint32_t halfway{ 1u << (shift - 1) };
+		if (rest > halfway || (rest == halfway && (half & 1)))
+			half++;
+		return static_cast<std::uint16_t>(sign | half);
+	}
+
+	std::uint32_t half{ sign | (static_cast<std::uint32_t>(exponent) << 10) | (mantissa >> 13) };
+	std::uint32_t rest{ mantissa & 0x1FFFu };
+	// carrying into the exponent is still correct
+	if (rest > 0x1000u || (rest == 0x1000u && (half & 1)))
+		half++;
+	return static_cast<std::uint16_t>(half);
+}
+
+// Signed normalized 10:10:10 with a 2 bit w, x in the lowest bits
+inline std::uint32_t packNormal(glm::vec3 normal)
+{
+	auto component = [](float value) {
+		float clamped{ std::min(std::max(value, -1.0f), 1.0f) };
+		return static_cast<std::uint32_t>(static_cast<std::int32_t>(std::round(clamped * 511.0f))) & 0x3FFu;
+	};
+	return component(normal.x) | (component(normal.y) << 10) | (component(normal.z) << 20);
+}
+
+// Packs a mesh with position, normal, uv (8 floats per vertex) into the chosen layout
+inline VertexData packVertices(const Mesh& mesh, VertexLayout layout)
+{
+	VertexData data;
+	if (layout == VertexLayout::Float)
+	{
+		data.bytes.resize(sizeof(float) * mesh.vertices.size());
+		std::memcpy(data.bytes.data(), mesh.vertices.data(), data.bytes.size());
+		return data;
+	}
+
+	glm::vec3 low{ mesh.position(0) };
+	glm::vec3 high{ low };
+	for (size_t v{ 0 }; v < mesh.vertexCount(); v++)
+	{
+		low = glm::min(low, mesh.position(static_cast<std::uint32_t>(v)));
+		high = glm::max(high, mesh.position(static_cast<std::uint32_t>(v)));
+	}
+
+	// shorts go from -32767 to 32767 across the bounds, the shader gets them unnormalized
+	glm::vec3 halfExtent{ glm::max((high - low) * 0.5f, glm::vec3(1e-8f)) };
+	data.positionOffset = (high + low) * 0.5f;
+	data.positionScale = halfExtent / 32767.0f;
+
+	std::vector<CompactVertex> vertices(mesh.vertexCount());
+	for (size_t v{ 0 }; v < vertices.size(); v++)
+	{
+		const float* source{ &mesh.vertices[v * mesh.floatsPerVertex] };
+		CompactVertex& vertex{ vertices[v] };
+
+		for (int axis{ 0 }; axis < 3; axis++)
+		{
+			float normalized{ (source[axis] - data.positionOffset[axis]) / halfExtent[axis] };
+			vertex.position[axis] = static_cast<std::int16_t>(std::round(std::min(std::max(normalized, -1.0f), 1.0f) * 32767.0f));
+		}
+		vertex.position[3] = 0;
+		vertex.normal = packNormal(glm::vec3(source[3], source[4], source[5]));
+		vertex.uv[0] = floatToHalf(source[6]);
+		vertex.uv[1] = floatToHalf(source[7]);
+	}
+
+	data.bytes.resize(sizeof(CompactVertex) * vertices.size());
+	std::memcpy(data.bytes.data(), vertices.data(), data.bytes.size());
+	return data;
+}
+
+inline GLsizei vertexStride(VertexLayout layout)
+{
+	return static_cast<GLsizei>(layout == VertexLayout::Float ? sizeof(float) * 8 : sizeof(CompactVertex));
+}
+
+// Attribute pointers for the currently bound VAO and array buffer
+// location 0 position, 1 normal, 2 uv, the light source VAO only needs the position
+inline void setVertexAttributes(VertexLayout layout, bool positionOnly = false)
+{
+	GLsizei stride{ vertexStride(layout) };
+
+	if (layout == VertexLayout::Float)
+	{
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+		glEnableVertexAttribArray(0);
+		if (positionOnly)
+			return;
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 3));
+		glEnableVertexAttribArray(1);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(float) * 6));
+		glEnableVertexAttribArray(2);
+		return;
+	}
+
+	glVertexAttribPointer(0, 3, GL_SHORT, GL_FALSE, stride, (void*)offsetof(CompactVertex, position));
+	glEnableVertexAttribArray(0);
+	if (positionOnly)
+		return;
+	glVertexAttribPointer(1, 4, GL_INT_2_10_10_10_REV, GL_TRUE, stride, (void*)offsetof(CompactVertex, normal));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, stride, (void*)offsetof(CompactVertex, uv));
+	glEnableVertexAttribArray(2);
+}